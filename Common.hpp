@@ -5,12 +5,25 @@
 
 static short port = 5555;
 
+// Инструмент по умолчанию, если в запросе не указано поле "Symbol"
+static std::string DefaultSymbol = "USD";
+
 namespace Requests
 {
     static std::string Registration = "Reg";
     static std::string Hello = "Hel";
     static std::string Trading = "Tra";
     static std::string Status = "Sta";
+    static std::string Cancel = "Can";
+    static std::string Amend = "Ame";
+    static std::string Deposit = "Dep";
+    static std::string CancelOnDisconnect = "Cod";
+    static std::string Auction = "Auc";
+    static std::string Policy = "Pol";
+    static std::string PriceBands = "Bnd";
+    static std::string Executions = "Exe";
+    static std::string OrderPool = "Opl";
+    static std::string EndOfSession = "Eos";
     static std::string Free = "Free";
 }
 
@@ -0,0 +1,47 @@
+#ifndef CLIENSERVERECN_EVENTRING_HPP
+#define CLIENSERVERECN_EVENTRING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Кольцевой буфер событий с глобальными порядковыми номерами (с 1). Память
+// выделяется один раз при создании; при переполнении самые старые события
+// перезаписываются, их номера становятся недоступны для чтения.
+template <typename Event, size_t Capacity = 65536>
+class EventRing
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    EventRing() : mEvents(Capacity) {}
+
+    // Записывает событие и возвращает его номер.
+    uint64_t Push(const Event& aEvent)
+    {
+        uint64_t sequence = ++mLast;
+        mEvents[sequence & (Capacity - 1)] = aEvent;
+        return sequence;
+    }
+
+    // Номер самого старого доступного события.
+    uint64_t First() const { return mLast >= Capacity ? mLast - Capacity + 1 : 1; }
+
+    // Обходит доступные события с номерами не меньше aFrom по порядку, пока
+    // aVisit(номер, событие) возвращает true.
+    template <typename Visitor>
+    void Visit(uint64_t aFrom, Visitor&& aVisit) const
+    {
+        for (uint64_t sequence = aFrom < First() ? First() : aFrom; sequence <= mLast; ++sequence)
+            if (!aVisit(sequence, mEvents[sequence & (Capacity - 1)]))
+                return;
+    }
+
+    void Clear() { mLast = 0; }
+
+private:
+    std::vector<Event> mEvents;
+    uint64_t mLast = 0;
+};
+
+#endif //CLIENSERVERECN_EVENTRING_HPP
@@ -0,0 +1,140 @@
+#ifndef CLIENSERVERECN_ORDERPOOL_HPP
+#define CLIENSERVERECN_ORDERPOOL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+// Пул объектов фиксированного размера: память выделяется непрерывными слэбами
+// по SlabSize объектов, освобождённые слоты переиспользуются через список свободных.
+// Объекты адресуются номером слота, который не меняется, пока слот занят.
+template <typename T, size_t SlabSize = 4096>
+class ObjectPool
+{
+public:
+    explicit ObjectPool(size_t aPreallocated = SlabSize)
+    {
+        while (Capacity() < aPreallocated)
+            AddSlab();
+    }
+
+    // Занимает свободный слот; новый слэб выделяется только при исчерпании пула.
+    uint32_t Acquire()
+    {
+        if (mFree.empty())
+            AddSlab();
+        uint32_t slot = mFree.back();
+        mFree.pop_back();
+        if (++mOccupancy > mHighWaterMark)
+            mHighWaterMark = mOccupancy;
+        return slot;
+    }
+
+    // Возвращает слот в пул. Объект не сбрасывается: его поля переживают
+    // освобождение (например, счётчик поколений).
+    void Release(uint32_t aSlot)
+    {
+        mFree.push_back(aSlot);
+        --mOccupancy;
+    }
+
+    // Освобождает все слоты и сбрасывает объекты и максимум занятости,
+    // слэбы остаются выделенными.
+    void Clear()
+    {
+        mFree.clear();
+        for (size_t slot = Capacity(); slot-- > 0;)
+        {
+            (*this)[static_cast<uint32_t>(slot)] = T();
+            mFree.push_back(static_cast<uint32_t>(slot));
+        }
+        mOccupancy = 0;
+        mHighWaterMark = 0;
+    }
+
+    T& operator[](uint32_t aSlot) { return mSlabs[aSlot / SlabSize][aSlot % SlabSize]; }
+    const T& operator[](uint32_t aSlot) const { return mSlabs[aSlot / SlabSize][aSlot % SlabSize]; }
+
+    size_t Capacity() const { return mSlabs.size() * SlabSize; }
+    size_t Occupancy() const { return mOccupancy; }
+    size_t HighWaterMark() const { return mHighWaterMark; }
+
+private:
+    std::vector<std::unique_ptr<T[]>> mSlabs;
+    std::vector<uint32_t> mFree;
+    size_t mOccupancy = 0;
+    size_t mHighWaterMark = 0;
+
+    void AddSlab()
+    {
+        size_t first = Capacity();
+        mSlabs.emplace_back(new T[SlabSize]);
+        mFree.reserve(first + SlabSize);
+        // Слоты выдаются по возрастанию номеров
+        for (size_t slot = first + SlabSize; slot-- > first;)
+            mFree.push_back(static_cast<uint32_t>(slot));
+    }
+};
+
+// Аллокатор для узловых контейнеров (std::map и т.п.): освобождённые одиночные
+// узлы складываются в общий для типа список и отдаются при следующем выделении.
+template <typename T>
+class RecyclingAllocator
+{
+public:
+    using value_type = T;
+
+    RecyclingAllocator() = default;
+    template <typename U>
+    RecyclingAllocator(const RecyclingAllocator<U>&) {}
+
+    T* allocate(size_t n)
+    {
+        FreeNode*& head = FreeList();
+        if (n == 1 && head)
+        {
+            FreeNode* node = head;
+            head = node->next;
+            return reinterpret_cast<T*>(node);
+        }
+        return static_cast<T*>(::operator new(n * NodeSize()));
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        if (n == 1)
+        {
+            FreeNode* node = reinterpret_cast<FreeNode*>(p);
+            node->next = FreeList();
+            FreeList() = node;
+            return;
+        }
+        ::operator delete(p);
+    }
+
+    template <typename U>
+    bool operator==(const RecyclingAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const RecyclingAllocator<U>&) const { return false; }
+
+private:
+    struct FreeNode
+    {
+        FreeNode* next;
+    };
+
+    static constexpr size_t NodeSize()
+    {
+        return sizeof(T) < sizeof(FreeNode) ? sizeof(FreeNode) : sizeof(T);
+    }
+
+    static FreeNode*& FreeList()
+    {
+        static FreeNode* head = nullptr;
+        return head;
+    }
+};
+
+#endif //CLIENSERVERECN_ORDERPOOL_HPP
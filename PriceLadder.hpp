@@ -0,0 +1,109 @@
+#ifndef CLIENSERVERECN_PRICELADDER_HPP
+#define CLIENSERVERECN_PRICELADDER_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Плотная лестница цен: уровни лежат в массиве по смещению в тиках от якоря.
+// Непустые уровни отмечены в двухуровневой битовой карте: бит слова - уровень,
+// бит сводки - непустое слово. Лучшая цена и соседний уровень находятся
+// командами поиска первого/последнего установленного бита.
+template <typename Level, size_t Width = 4096>
+class PriceLadder
+{
+    static_assert(Width % 64 == 0 && Width <= 64 * 64, "Width must fit a two-level bitmap");
+
+public:
+    // Переносит якорь; допустимо только для пустой лестницы.
+    void SetAnchor(int64_t aAnchor) { mAnchor = aAnchor; }
+
+    bool Contains(int64_t aPrice) const
+    {
+        return static_cast<uint64_t>(aPrice - mAnchor) < Width;
+    }
+
+    bool Empty() const { return mSummary == 0; }
+
+    Level& operator[](int64_t aPrice) { return mLevels[aPrice - mAnchor]; }
+
+    // Отмечает уровень непустым/пустым.
+    void Set(int64_t aPrice)
+    {
+        size_t offset = aPrice - mAnchor;
+        mWords[offset / 64] |= uint64_t(1) << (offset % 64);
+        mSummary |= uint64_t(1) << (offset / 64);
+    }
+
+    void Reset(int64_t aPrice)
+    {
+        size_t offset = aPrice - mAnchor;
+        uint64_t& word = mWords[offset / 64];
+        word &= ~(uint64_t(1) << (offset % 64));
+        if (word == 0)
+            mSummary &= ~(uint64_t(1) << (offset / 64));
+    }
+
+    // Наименьшая и наибольшая непустые цены; лестница не должна быть пустой.
+    int64_t Lowest() const
+    {
+        size_t word = __builtin_ctzll(mSummary);
+        return mAnchor + word * 64 + __builtin_ctzll(mWords[word]);
+    }
+
+    int64_t Highest() const
+    {
+        size_t word = 63 - __builtin_clzll(mSummary);
+        return mAnchor + word * 64 + 63 - __builtin_clzll(mWords[word]);
+    }
+
+    // Ближайшая непустая цена строго ниже aPrice; false, если такой нет.
+    bool Below(int64_t aPrice, int64_t& aResult) const
+    {
+        int64_t offset = aPrice - mAnchor;
+        if (offset <= 0)
+            return false;
+        size_t last = offset > static_cast<int64_t>(Width) ? Width - 1 : offset - 1;
+        size_t word = last / 64;
+        uint64_t bits = mWords[word] & (~uint64_t(0) >> (63 - last % 64));
+        if (bits == 0)
+        {
+            uint64_t summary = word == 0 ? 0 : mSummary & (~uint64_t(0) >> (64 - word));
+            if (summary == 0)
+                return false;
+            word = 63 - __builtin_clzll(summary);
+            bits = mWords[word];
+        }
+        aResult = mAnchor + word * 64 + 63 - __builtin_clzll(bits);
+        return true;
+    }
+
+    // Ближайшая непустая цена строго выше aPrice; false, если такой нет.
+    bool Above(int64_t aPrice, int64_t& aResult) const
+    {
+        int64_t offset = aPrice - mAnchor;
+        if (offset >= static_cast<int64_t>(Width) - 1)
+            return false;
+        size_t first = offset < 0 ? 0 : offset + 1;
+        size_t word = first / 64;
+        uint64_t bits = mWords[word] & (~uint64_t(0) << (first % 64));
+        if (bits == 0)
+        {
+            uint64_t summary = word == 63 ? 0 : mSummary & (~uint64_t(0) << (word + 1));
+            if (summary == 0)
+                return false;
+            word = __builtin_ctzll(summary);
+            bits = mWords[word];
+        }
+        aResult = mAnchor + word * 64 + __builtin_ctzll(bits);
+        return true;
+    }
+
+private:
+    int64_t mAnchor = 0;
+    uint64_t mSummary = 0;
+    std::array<uint64_t, Width / 64> mWords{};
+    std::array<Level, Width> mLevels{};
+};
+
+#endif //CLIENSERVERECN_PRICELADDER_HPP
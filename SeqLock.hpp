@@ -0,0 +1,102 @@
+#ifndef CLIENSERVERECN_SEQLOCK_HPP
+#define CLIENSERVERECN_SEQLOCK_HPP
+
+#include <atomic>
+#include <cstdint>
+
+// Счетчик версий для чтения без блокировок (seqlock). Писатель один и никогда
+// не ждет: на время изменения версия нечетная. Читатель повторяет чтение,
+// пока до и после него не увидит одну и ту же четную версию.
+class SeqLock
+{
+public:
+    // Изменение защищенных данных на время жизни объекта.
+    class Writer
+    {
+    public:
+        explicit Writer(SeqLock& aLock) : mLock(aLock)
+        {
+            mLock.mSequence.store(mLock.mSequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+
+        ~Writer()
+        {
+            mLock.mSequence.store(mLock.mSequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+
+    private:
+        SeqLock& mLock;
+    };
+
+    // Выполняет aRead, пока чтение не пройдет без параллельной записи.
+    // aRead должен только копировать данные: его результат до проверки
+    // версии может быть несогласованным.
+    template <typename Reader>
+    void Read(Reader&& aRead) const
+    {
+        while (true)
+        {
+            uint32_t before = mSequence.load(std::memory_order_acquire);
+            if ((before & 1) == 0)
+            {
+                aRead();
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (mSequence.load(std::memory_order_relaxed) == before)
+                    return;
+            }
+        }
+    }
+
+private:
+    std::atomic<uint32_t> mSequence{0};
+};
+
+// Поле, защищенное SeqLock. Читатель копирует его, пока писатель может
+// менять, поэтому доступ атомарный (relaxed) и чтение не является гонкой
+// данных. Писатель один: изменение - обычные чтение и запись, без
+// блокирующих инструкций.
+template <typename T>
+class SeqLockField
+{
+public:
+    SeqLockField(T aValue = T()) : mValue(aValue) {}
+    SeqLockField(const SeqLockField& aOther) : mValue(aOther.Load()) {}
+
+    SeqLockField& operator=(const SeqLockField& aOther)
+    {
+        Store(aOther.Load());
+        return *this;
+    }
+
+    SeqLockField& operator=(T aValue)
+    {
+        Store(aValue);
+        return *this;
+    }
+
+    SeqLockField& operator+=(T aDelta)
+    {
+        Store(Load() + aDelta);
+        return *this;
+    }
+
+    SeqLockField& operator-=(T aDelta)
+    {
+        Store(Load() - aDelta);
+        return *this;
+    }
+
+    operator T() const { return Load(); }
+
+    T Load() const { return mValue.load(std::memory_order_relaxed); }
+    void Store(T aValue) { mValue.store(aValue, std::memory_order_relaxed); }
+
+private:
+    std::atomic<T> mValue;
+};
+
+#endif //CLIENSERVERECN_SEQLOCK_HPP
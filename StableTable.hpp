@@ -0,0 +1,48 @@
+#ifndef CLIENSERVERECN_STABLETABLE_HPP
+#define CLIENSERVERECN_STABLETABLE_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <stdexcept>
+
+// Таблица, которая только растет: элементы лежат страницами по PageSize,
+// каталог страниц фиксированного размера. При росте ни элементы, ни каталог
+// не перемещаются, поэтому добавленные элементы можно читать из других
+// потоков, пока единственный писатель добавляет новые.
+template <typename T, size_t PageSize = 4096, size_t MaxPages = 4096>
+class StableTable
+{
+public:
+    // Добавляет в конец элемент, построенный заново, и возвращает его.
+    T& EmplaceBack()
+    {
+        size_t index = mSize.load(std::memory_order_relaxed);
+        if (index / PageSize >= MaxPages)
+            throw std::length_error("StableTable is full");
+        std::unique_ptr<T[]>& page = mPages[index / PageSize];
+        if (!page)
+            page.reset(new T[PageSize]);
+        T& element = page[index % PageSize];
+        element.~T();
+        new (&element) T();
+        mSize.store(index + 1, std::memory_order_release);
+        return element;
+    }
+
+    // Забывает все элементы, страницы остаются выделенными.
+    void Clear() { mSize.store(0, std::memory_order_release); }
+
+    size_t Size() const { return mSize.load(std::memory_order_acquire); }
+
+    T& operator[](size_t aIndex) { return mPages[aIndex / PageSize][aIndex % PageSize]; }
+    const T& operator[](size_t aIndex) const { return mPages[aIndex / PageSize][aIndex % PageSize]; }
+
+private:
+    std::array<std::unique_ptr<T[]>, MaxPages> mPages;
+    std::atomic<size_t> mSize{0};
+};
+
+#endif //CLIENSERVERECN_STABLETABLE_HPP
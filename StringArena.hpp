@@ -0,0 +1,53 @@
+#ifndef CLIENSERVERECN_STRINGARENA_HPP
+#define CLIENSERVERECN_STRINGARENA_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Хранилище строк только на добавление: строки копируются подряд в блоки
+// по ChunkSize байт, блоки не перемещаются, поэтому выданные string_view
+// действительны до Clear. Строка длиннее блока получает отдельный блок.
+template <size_t ChunkSize = 64 * 1024>
+class StringArena
+{
+public:
+    // Копирует строку в хранилище и возвращает ссылку на копию.
+    std::string_view Intern(std::string_view aString)
+    {
+        if (mChunks.empty() || mUsed + aString.size() > mChunkCapacity)
+            AddChunk(aString.size());
+        char* data = mChunks[mCurrent].get() + mUsed;
+        std::memcpy(data, aString.data(), aString.size());
+        mUsed += aString.size();
+        return std::string_view(data, aString.size());
+    }
+
+    // Забывает все строки; первый блок остается для повторного заполнения.
+    void Clear()
+    {
+        if (mChunks.size() > 1)
+            mChunks.resize(1);
+        mCurrent = 0;
+        mUsed = 0;
+        mChunkCapacity = mChunks.empty() ? 0 : ChunkSize;
+    }
+
+private:
+    std::vector<std::unique_ptr<char[]>> mChunks;
+    size_t mCurrent = 0;
+    size_t mUsed = 0;
+    size_t mChunkCapacity = 0;
+
+    void AddChunk(size_t aAtLeast)
+    {
+        mChunkCapacity = aAtLeast > ChunkSize ? aAtLeast : ChunkSize;
+        mChunks.emplace_back(new char[mChunkCapacity]);
+        mCurrent = mChunks.size() - 1;
+        mUsed = 0;
+    }
+};
+
+#endif //CLIENSERVERECN_STRINGARENA_HPP
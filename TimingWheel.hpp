@@ -0,0 +1,172 @@
+#ifndef CLIENSERVERECN_TIMINGWHEEL_HPP
+#define CLIENSERVERECN_TIMINGWHEEL_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "OrderPool.hpp"
+
+// Иерархическое колесо таймеров. Уровень l из 2^Bits ячеек покрывает
+// 2^(Bits*(l+1)) тиков; таймер кладется на младший уровень, где его срок
+// отличается от текущего времени только в разрядах этого уровня. Когда время
+// доходит до ячейки старшего уровня, её таймеры переносятся на младшие.
+// Сроки дальше старшего уровня лежат в отдельной корзине и перепроверяются
+// при каждом обороте колеса. Постановка и снятие таймера - O(1).
+template <size_t Bits = 6, size_t Levels = 4>
+class TimingWheel
+{
+    static_assert(Bits * Levels < 64, "Wheel range must fit a 64-bit time");
+
+public:
+    using TimerId = uint32_t;
+    static constexpr TimerId NoTimer = UINT32_MAX;
+
+    explicit TimingWheel(uint64_t aNow = 0) : mNow(aNow)
+    {
+        mHeads.fill(NoTimer);
+    }
+
+    uint64_t Now() const { return mNow; }
+
+    // Ставит таймер на момент aDeadline (не раньше следующего тика);
+    // по срабатыванию в обработчик передается aPayload.
+    TimerId Schedule(uint64_t aDeadline, uint32_t aPayload)
+    {
+        TimerId id = mTimers.Acquire();
+        Timer& timer = mTimers[id];
+        timer.deadline = aDeadline > mNow ? aDeadline : mNow + 1;
+        timer.payload = aPayload;
+        Place(id);
+        return id;
+    }
+
+    void Cancel(TimerId aId)
+    {
+        Unlink(aId);
+        mTimers.Release(aId);
+    }
+
+    // Продвигает время до aNow и вызывает aExpire(payload) для каждого
+    // истекшего таймера. Пустые младшие уровни проходятся скачком до
+    // ближайшего тика, на котором есть что переносить.
+    template <typename Expire>
+    void Advance(uint64_t aNow, Expire&& aExpire)
+    {
+        while (mNow < aNow)
+        {
+            if (mTimers.Occupancy() == 0)
+            {
+                mNow = aNow;
+                return;
+            }
+            uint64_t step = 1;
+            for (size_t level = 0; level < Levels && mSizes[level] == 0; ++level)
+                step = uint64_t(1) << (Bits * (level + 1));
+            uint64_t next = (mNow | (step - 1)) + 1;
+            if (next > aNow)
+            {
+                mNow = aNow;
+                return;
+            }
+            mNow = next;
+            Tick(aExpire);
+        }
+    }
+
+    // Снимает все таймеры и переставляет время.
+    void Clear(uint64_t aNow)
+    {
+        mTimers.Clear();
+        mHeads.fill(NoTimer);
+        mSizes.fill(0);
+        mNow = aNow;
+    }
+
+private:
+    static constexpr size_t Slots = size_t(1) << Bits;
+    static constexpr uint64_t Mask = Slots - 1;
+    // Корзина сроков дальше старшего уровня
+    static constexpr size_t Overflow = Levels * Slots;
+
+    struct Timer
+    {
+        uint64_t deadline = 0;
+        uint32_t payload = 0;
+        uint32_t bucket = 0;
+        TimerId prev = NoTimer;
+        TimerId next = NoTimer;
+    };
+
+    ObjectPool<Timer> mTimers;
+    std::array<TimerId, Overflow + 1> mHeads;
+    // Число таймеров на каждом уровне и в корзине дальних сроков
+    std::array<size_t, Levels + 1> mSizes{};
+    uint64_t mNow;
+
+    void Place(TimerId aId)
+    {
+        Timer& timer = mTimers[aId];
+        uint64_t diff = timer.deadline ^ mNow;
+        size_t level = 0;
+        while (level < Levels && (diff >> (Bits * (level + 1))) != 0)
+            ++level;
+        timer.bucket = level == Levels ? Overflow : level * Slots + ((timer.deadline >> (Bits * level)) & Mask);
+        timer.prev = NoTimer;
+        timer.next = mHeads[timer.bucket];
+        if (timer.next != NoTimer)
+            mTimers[timer.next].prev = aId;
+        mHeads[timer.bucket] = aId;
+        ++mSizes[timer.bucket / Slots];
+    }
+
+    void Unlink(TimerId aId)
+    {
+        Timer& timer = mTimers[aId];
+        if (timer.prev != NoTimer)
+            mTimers[timer.prev].next = timer.next;
+        else
+            mHeads[timer.bucket] = timer.next;
+        if (timer.next != NoTimer)
+            mTimers[timer.next].prev = timer.prev;
+        --mSizes[timer.bucket / Slots];
+    }
+
+    // Переносит таймеры корзины на уровни по текущему времени. Список корзины
+    // отцепляется целиком: дальний срок может вернуться в ту же корзину.
+    void Cascade(size_t aBucket)
+    {
+        TimerId id = mHeads[aBucket];
+        mHeads[aBucket] = NoTimer;
+        while (id != NoTimer)
+        {
+            TimerId next = mTimers[id].next;
+            --mSizes[aBucket / Slots];
+            Place(id);
+            id = next;
+        }
+    }
+
+    // Тик mNow: сначала переносы со старших уровней, затем срабатывание
+    // ячейки младшего. Таймер снимается до вызова обработчика, так что
+    // обработчик может снимать и другие таймеры.
+    template <typename Expire>
+    void Tick(Expire& aExpire)
+    {
+        if ((mNow & ((uint64_t(1) << (Bits * Levels)) - 1)) == 0)
+            Cascade(Overflow);
+        for (size_t level = Levels - 1; level > 0; --level)
+            if ((mNow & ((uint64_t(1) << (Bits * level)) - 1)) == 0)
+                Cascade(level * Slots + ((mNow >> (Bits * level)) & Mask));
+        size_t bucket = mNow & Mask;
+        while (mHeads[bucket] != NoTimer)
+        {
+            TimerId id = mHeads[bucket];
+            uint32_t payload = mTimers[id].payload;
+            Cancel(id);
+            aExpire(payload);
+        }
+    }
+};
+
+#endif //CLIENSERVERECN_TIMINGWHEEL_HPP
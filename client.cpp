@@ -71,6 +71,8 @@ int main()
                          "2) Exit\n"
                          "3) Trading\n"
                          "4) Check status\n"
+                         "5) Cancel order\n"
+                         "6) Amend order\n"
                          << std::endl;
 
             short menu_option_num;
@@ -107,6 +109,24 @@ int main()
                     std::cout << ReadMessage(s);
                     break;
                 }
+                case 5:
+                {
+                    std::string orderId;
+                    std::cout << "Input order id" << std::endl;
+                    std::cin >> orderId;
+                    SendMessage(s, my_id, Requests::Cancel, orderId);
+                    std::cout << ReadMessage(s);
+                    break;
+                }
+                case 6:
+                {
+                    std::string terms;
+                    std::cout << "Input terms" << std::endl;
+                    std::cin >> terms; // Ввводим в виде "id:объем:цена"
+                    SendMessage(s, my_id, Requests::Amend, terms);
+                    std::cout << ReadMessage(s);
+                    break;
+                }
                 default:
                 {
                     std::cout << "Unknown menu option\n" << std::endl;
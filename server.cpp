@@ -1,10 +1,26 @@
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
-#include <list>
+#include <deque>
+#include <map>
+#include <type_traits>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
 #include <iostream>
 #include <boost/bind/bind.hpp>
 #include <boost/asio.hpp>
 #include "json.hpp"
 #include "Common.hpp"
+#include "EventRing.hpp"
+#include "OrderPool.hpp"
+#include "PriceLadder.hpp"
+#include "SeqLock.hpp"
+#include "StableTable.hpp"
+#include "StringArena.hpp"
+#include "TimingWheel.hpp"
 
 using boost::asio::ip::tcp;
 
@@ -18,263 +34,1926 @@ std::vector<size_t> find_all(const std::string& str, char target) {
     return positions;
 }
 
+// Цены хранятся целым числом тиков, количество USD - целым числом лотов,
+// деньги - в единицах "тик * лот". Масштабы задаются при сборке.
+#ifndef TRADE_PRICE_SCALE
+#define TRADE_PRICE_SCALE 100
+#endif
+#ifndef TRADE_QUANTITY_SCALE
+#define TRADE_QUANTITY_SCALE 100
+#endif
+
+using Price = int64_t;
+using Quantity = int64_t;
+using Amount = int64_t;
+
+static constexpr int64_t PriceScale = TRADE_PRICE_SCALE;
+static constexpr int64_t QuantityScale = TRADE_QUANTITY_SCALE;
+static constexpr int64_t AmountScale = PriceScale * QuantityScale;
+
+// Ответы клиенту печатаются с шестью знаками после точки, как std::to_string.
+static constexpr int64_t TextScale = 1000000;
+static_assert(TextScale % AmountScale == 0, "Scales must divide 10^6");
+
+// Наименьшее k, при котором 10^k не меньше aValue.
+constexpr size_t ceilLog10(int64_t aValue, int64_t aPower = 1)
+{
+    return aPower >= aValue ? 0 : 1 + ceilLog10(aValue, aPower * 10);
+}
+
+// Предел знаков во вводе. Количество и цена не длиннее ValueDigits знаков,
+// тогда их произведение в единицах Amount меньше 10^18; сумма денег
+// не длиннее AmountDigits знаков. Так значения и их суммы помещаются в int64_t.
+static constexpr size_t ValueDigits = (18 - ceilLog10(AmountScale)) / 2;
+static constexpr size_t AmountDigits = 18 - ceilLog10(AmountScale);
+static_assert(ValueDigits >= 6, "Scales leave too few digits for quantities and prices");
+
+// Разбор неотрицательного десятичного числа в целое число единиц 1/aScale.
+// Лишние знаки после точки, пустая строка и посторонние символы - ошибка.
+// Всего знаков не больше aMaxDigits: по умолчанию так, чтобы
+// произведение количества на цену помещалось в Amount.
+int64_t parseFixed(const std::string& str, int64_t aScale, size_t aMaxDigits = ValueDigits) {
+    int64_t whole = 0;
+    int64_t fraction = 0;
+    int64_t fractionScale = 1;
+    size_t digits = 0;
+    size_t i = 0;
+    for (; i < str.size() && str[i] != '.'; ++i) {
+        if (str[i] < '0' || str[i] > '9' || ++digits > aMaxDigits)
+            throw std::runtime_error("Invalid number: " + str);
+        whole = whole * 10 + (str[i] - '0');
+    }
+    if (i < str.size()) {
+        for (++i; i < str.size(); ++i) {
+            if (str[i] < '0' || str[i] > '9' || fractionScale >= aScale)
+                throw std::runtime_error("Invalid number: " + str);
+            fraction = fraction * 10 + (str[i] - '0');
+            fractionScale *= 10;
+            ++digits;
+        }
+    }
+    if (digits == 0)
+        throw std::runtime_error("Invalid number: " + str);
+    return whole * aScale + fraction * (aScale / fractionScale);
+}
+
+// Печать числа в единицах 1/aScale в виде "-1830.000000".
+std::string formatFixed(int64_t value, int64_t aScale) {
+    uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+    std::string fraction = std::to_string(magnitude % aScale * (TextScale / aScale));
+    return (value < 0 ? "-" : "") + std::to_string(magnitude / aScale) + "."
+        + std::string(6 - fraction.size(), '0') + fraction;
+}
+
+// Номер инструмента в справочнике символов, индекс его стакана.
+using SymbolId = uint32_t;
+
+// Нет заявки: пустая ссылка в интрузивных очередях.
+static constexpr uint32_t NoOrder = UINT32_MAX;
+
+// Позиция счета по одному инструменту: всего и зарезервировано под заявки на продажу.
+// Всего читается без блокировок под версией счета.
+struct Holding {
+    SeqLockField<Quantity> total = 0;
+    Quantity reserved = 0;
+};
+
+// Счет пользователя: только поля, которые читает и меняет сведение. Имя
+// хранится отдельно (Core::mUserNames) и не занимает место в кэше при сделках.
+// Позиции и деньги меняются под версией: их читают без блокировок (Core::ReadBalance).
 struct Balance {
-    std::string userName;
-    double usd;
-    double money;
+    SeqLock version;
+    // Позиции по инструментам, индекс - SymbolId. Массив не растет на месте:
+    // при росте заводится копия, прежний живет до Core::Free, его могут читать.
+    std::atomic<std::vector<Holding>*> holdings{nullptr};
+    SeqLockField<Amount> money = 0;
+    // Деньги, зарезервированные под заявки на покупку
+    Amount reservedMoney = 0;
+    // Первая в списке стоящих заявок пользователя
+    uint32_t orders = NoOrder;
+    // Номер накопленного изменения в текущем проходе сведения
+    uint32_t pending = NoOrder;
+};
+
+// Изменение счета за проход сведения: сделки прохода копятся здесь, по одной
+// записи на счет, и применяются к счету один раз в конце прохода. Проход идет
+// по одному стакану, поэтому инструмент у записи один.
+struct SettlementDelta {
+    int user = 0;
+    SymbolId symbol = 0;
+    Quantity total = 0;
+    Quantity reserved = 0;
+    Amount money = 0;
+    Amount reservedMoney = 0;
+};
+
+// Идентификатор заявки в стакане: номер слота и его поколение.
+using OrderId = uint64_t;
+
+// Срок действия заявки: 0 - до отмены, иначе время истечения в миллисекундах
+// от начала эпохи. Заявка на день снимается по концу торговой сессии.
+using Expiry = uint64_t;
+static constexpr Expiry UntilEndOfDay = UINT64_MAX;
+
+// Текущее время в миллисекундах от начала эпохи, шкала сроков Expiry.
+uint64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+enum class Side : uint8_t
+{
+    Buy,
+    Sell
+};
+
+// Тип заявки. Рыночная, IOC и FOK исполняются сразу и никогда не встают в стакан:
+// рыночная и IOC снимают неисполненный остаток, FOK исполняется только целиком.
+// Стоп и стоп-лимит ждут, пока цена последней сделки дойдет до цены стопа,
+// и затем становятся рыночной и лимитной заявкой соответственно.
+enum class OrderType : uint8_t
+{
+    Limit,
+    Market,
+    ImmediateOrCancel,
+    FillOrKill,
+    Stop,
+    StopLimit
+};
+
+// Итог обработки новой заявки ядром
+enum class Outcome : uint8_t
+{
+    Filled,
+    Resting,
+    Cancelled,
+    Killed,
+    Rejected,
+    Suspended,
+    WouldCross,
+    OutOfBand
+};
+
+// Защита от сделки пользователя с самим собой, задается входящей заявкой:
+// снять входящую (новую), снять стоящую (старую) или уменьшить обе на
+// пересекающийся объем без сделки.
+enum class StpMode : uint8_t
+{
+    None,
+    CancelNewest,
+    CancelOldest,
+    DecrementBoth
+};
+
+// Правило распределения объема входящей заявки между заявками ценового уровня:
+// по времени (FIFO) или пропорционально объему заявок.
+enum class MatchingPolicy : uint8_t
+{
+    PriceTime,
+    ProRata
+};
+
+// Необязательные поля запроса на торговлю в том виде, как их прислал клиент.
+struct DealParams {
+    std::string symbol = DefaultSymbol;
+    std::string type = "limit";
+    std::string stp = "none";
+    // Цена стопа, только для стоп-заявок
+    std::string stopPrice;
+    // Видимая часть айсберга, только для лимитных заявок
+    std::string peak;
+    // Срок действия: "" - до отмены, "day" - до конца сессии, иначе время в мс
+    std::string expire;
+    // Только добавление ликвидности: заявка не должна исполниться при входе
+    bool postOnly = false;
+    // Минимальный объем немедленного исполнения
+    std::string minQty;
+};
+
+// Необязательное поле запроса строкой: число принимается в десятичной
+// записи, поле другого типа бросает nlohmann::json::type_error.
+std::string optionalField(const nlohmann::json& aRequest, const char* aName, const std::string& aDefault) {
+    const auto it = aRequest.find(aName);
+    if (it == aRequest.end())
+        return aDefault;
+    if (it->is_number())
+        return it->dump();
+    return it->get<std::string>();
+}
+
+StpMode parseStpMode(const std::string& str) {
+    if (str == "none")
+        return StpMode::None;
+    if (str == "cancel-newest")
+        return StpMode::CancelNewest;
+    if (str == "cancel-oldest")
+        return StpMode::CancelOldest;
+    if (str == "decrement-both")
+        return StpMode::DecrementBoth;
+    throw std::runtime_error("Unknown self-trade prevention mode: " + str);
+}
+
+OrderType parseOrderType(const std::string& str) {
+    if (str == "limit")
+        return OrderType::Limit;
+    if (str == "market")
+        return OrderType::Market;
+    if (str == "ioc")
+        return OrderType::ImmediateOrCancel;
+    if (str == "fok")
+        return OrderType::FillOrKill;
+    if (str == "stop")
+        return OrderType::Stop;
+    if (str == "stop-limit")
+        return OrderType::StopLimit;
+    throw std::runtime_error("Unknown order type: " + str);
+}
+
+// Свойства стороны входящей заявки для шаблонного ядра сведения.
+template <Side S>
+struct SideTraits;
+
+template <>
+struct SideTraits<Side::Buy>
+{
+    static constexpr Side Opposite = Side::Sell;
+    // Порядок уровней от лучшей цены: для покупок - по убыванию.
+    using Better = std::greater<Price>;
+    // Цена рыночной заявки пересекает любой уровень встречной стороны.
+    static constexpr Price MarketPrice = INT64_MAX;
+    // Покупка пересекается с продажей, цена которой не выше цены покупки.
+    static bool Crosses(Price aIncoming, Price aResting) { return aResting <= aIncoming; }
+    // Стоп-покупка срабатывает, когда цена сделки поднялась до цены стопа.
+    static bool Triggers(Price aStop, Price aLast) { return aLast >= aStop; }
+    template <typename T>
+    static T& Buyer(T& aIncoming, T&) { return aIncoming; }
+    template <typename T>
+    static T& Seller(T&, T& aResting) { return aResting; }
+};
+
+template <>
+struct SideTraits<Side::Sell>
+{
+    static constexpr Side Opposite = Side::Buy;
+    using Better = std::less<Price>;
+    static constexpr Price MarketPrice = 0;
+    // Продажа пересекается с покупкой, цена которой не ниже цены продажи.
+    static bool Crosses(Price aIncoming, Price aResting) { return aResting >= aIncoming; }
+    static bool Triggers(Price aStop, Price aLast) { return aLast <= aStop; }
+    template <typename T>
+    static T& Buyer(T&, T& aResting) { return aResting; }
+    template <typename T>
+    static T& Seller(T& aIncoming, T&) { return aIncoming; }
 };
 
 struct Record {
         int id;
-        double usd;
-        double price;
-        std::string side;
-        double position;
+        SymbolId symbol;
+        OrderId orderId;
+        Quantity usd;
+        Price price;
+        Side side;
+        OrderType type;
+        StpMode stp;
+        // Цена стопа ожидающей стоп-заявки, 0 - заявка не ждет срабатывания
+        Price stopPrice;
+        // Айсберг: в стакане виден объем не больше peak, остальное - в скрытом
+        // резерве hidden. У обычной заявки peak равен 0.
+        Quantity peak;
+        Quantity hidden;
+        Expiry expiry;
+        // Заявка только встает в стакан; minQty - исполнение не меньше этого объема
+        bool postOnly;
+        Quantity minQty;
+        uint64_t position;
 
         Record()
         {
             id = 0;
+            symbol = 0;
+            orderId = 0;
             usd = 0;
             price = 0;
-            side = "None";
+            side = Side::Buy;
+            type = OrderType::Limit;
+            stp = StpMode::None;
+            stopPrice = 0;
+            peak = 0;
+            hidden = 0;
+            expiry = 0;
+            postOnly = false;
+            minQty = 0;
             position = 0;
         }
-        Record(const std::string& deal)
+        Record(const std::string& deal, const DealParams& aParams = DealParams()) : Record()
         {
+            type = parseOrderType(aParams.type);
+            stp = parseStpMode(aParams.stp);
+            bool market = type == OrderType::Market || type == OrderType::Stop;
             std::vector<size_t> delimiters = find_all(deal, ':');
             
             if (delimiters.size() != 2)
             {
             throw std::runtime_error("Invalid input format: expected at least two delimiters.");
             }
+            // У рыночной заявки цена не указывается: "объем::операция"
+            std::string priceTerm = deal.substr(delimiters[0] + 1, delimiters[1] - delimiters[0] - 1);
             try {
-                usd = std::stof(deal.substr(0, delimiters[0]));
-                price = std::stof(deal.substr(delimiters[0] + 1, delimiters[1] - delimiters[0] - 1));
+                usd = parseFixed(deal.substr(0, delimiters[0]), QuantityScale);
+                price = market ? 0 : parseFixed(priceTerm, PriceScale);
+                stopPrice = aParams.stopPrice.empty() ? 0 : parseFixed(aParams.stopPrice, PriceScale);
+                peak = aParams.peak.empty() ? 0 : parseFixed(aParams.peak, QuantityScale);
+                expiry = aParams.expire.empty() ? 0 : aParams.expire == "day" ? UntilEndOfDay : parseFixed(aParams.expire, 1, 15);
+                minQty = aParams.minQty.empty() ? 0 : parseFixed(aParams.minQty, QuantityScale);
             }
             catch (const std::exception& e) {
                 std::cerr << e.what() << '\n';
                 throw;
             }
-            side = deal.substr(delimiters[1] + 1, deal.size() - delimiters[1] - 1);
-            if (side != "buy" && side != "sell")
+            if (usd == 0 || (price == 0 && !market))
+            {
+            throw std::runtime_error("Zero quantity or price.");
+            }
+            if ((stopPrice != 0) != (type == OrderType::Stop || type == OrderType::StopLimit))
+            {
+            throw std::runtime_error("Stop price without a stop order.");
+            }
+            hidden = 0;
+            if ((!aParams.peak.empty() && peak == 0) || (peak != 0 && type != OrderType::Limit))
+            {
+            throw std::runtime_error("Peak without a limit order.");
+            }
+            // Срок имеет смысл только у заявки, которая может ждать в стакане
+            if (expiry != 0 && type != OrderType::Limit && type != OrderType::Stop && type != OrderType::StopLimit)
+            {
+            throw std::runtime_error("Expiry for an immediate order.");
+            }
+            postOnly = aParams.postOnly;
+            if ((postOnly && (type != OrderType::Limit || minQty != 0))
+                || (!aParams.minQty.empty() && (minQty == 0 || minQty > usd || stopPrice != 0)))
+            {
+            throw std::runtime_error("Invalid order instructions.");
+            }
+            std::string term = deal.substr(delimiters[1] + 1, deal.size() - delimiters[1] - 1);
+            if (term == "buy")
+                side = Side::Buy;
+            else if (term == "sell")
+                side = Side::Sell;
+            else
             {
             throw std::runtime_error("Unknuwn term.");
             }
+            if (market)
+            {
+                if (!priceTerm.empty())
+                    throw std::runtime_error("Market order with a price.");
+                price = side == Side::Buy ? SideTraits<Side::Buy>::MarketPrice : SideTraits<Side::Sell>::MarketPrice;
+            }
         }
     };
 
-std::list<Record> filterBuyOrders(const std::list<Record>& orders) {
-    std::list<Record> buyOrders;
-    std::copy_if(orders.begin(), orders.end(), std::back_inserter(buyOrders),
-                 [](const Record& record) { return record.side == "buy"; });
-    return buyOrders;
+// Цена, по которой под покупку резервируются деньги. У рыночной покупки
+// (в том числе стоп) предела цены нет, резерв под нее не создается:
+// перед сведением проверяется, хватает ли денег (Core::Affordable).
+Price reservePrice(const Record& aDeal) {
+    return aDeal.type == OrderType::Market || aDeal.type == OrderType::Stop ? 0 : aDeal.price;
 }
 
-std::list<Record> filterSellOrders(const std::list<Record>& orders) {
-    std::list<Record> sellOrders;
-    std::copy_if(orders.begin(), orders.end(), std::back_inserter(sellOrders),
-                 [](const Record& record) { return record.side == "sell"; });
-    return sellOrders;
-}
+// Отчет об исполнении: сделка между заявкой-инициатором (taker) и стоящей
+// заявкой (maker). remaining - остаток инициатора после сделки. OrderId
+// инициатора равен 0, если заявка еще не стояла в стакане.
+struct ExecutionReport {
+    SymbolId symbol = 0;
+    int taker = 0;
+    int maker = 0;
+    OrderId takerOrder = 0;
+    OrderId makerOrder = 0;
+    Price price = 0;
+    Quantity usd = 0;
+    Quantity remaining = 0;
+};
 
-void sortOrdersByPriceAscending(std::list<Record>& orders) 
-{
-    orders.sort([](const Record& a, const Record& b) {return (a.price < b.price) || (a.price == b.price && a.position < b.position);});
-}
+// Ценовой уровень: интрузивная очередь заявок с одной ценой в порядке поступления (FIFO).
+// total - суммарный видимый объем заявок уровня, hidden - скрытый объем айсбергов.
+struct PriceLevel {
+    uint32_t head = NoOrder;
+    uint32_t tail = NoOrder;
+    Quantity total = 0;
+    Quantity hidden = 0;
+};
 
-void sortOrdersByPriceDescending(std::list<Record>& orders) 
+// Стоящая заявка в пуле. Номер слота вместе с поколением образует OrderId,
+// поколение отличает переиспользованный слот. prev/next - соседи по очереди уровня,
+// userPrev/userNext - по списку заявок того же пользователя, dayPrev/dayNext -
+// по списку заявок на день. timer - таймер истечения срока заявки.
+struct OrderNode {
+    Record record;
+    uint32_t generation = 0;
+    bool resting = false;
+    uint32_t prev = NoOrder;
+    uint32_t next = NoOrder;
+    uint32_t userPrev = NoOrder;
+    uint32_t userNext = NoOrder;
+    uint32_t dayPrev = NoOrder;
+    uint32_t dayNext = NoOrder;
+    uint32_t timer = TimingWheel<>::NoTimer;
+    PriceLevel* level = nullptr;
+};
+
+// Сторона стакана. Уровни в полосе вокруг якоря лежат в плотной лестнице,
+// цены вне полосы - в упорядоченной карте. Полоса переносится к цене заявки,
+// если лестница пуста или цена вне полосы станет лучшей на стороне, так что
+// лучшие уровни остаются в лестнице, куда бы ни ушел рынок.
+template <Side S>
+class BookSide
 {
-    orders.sort([](const Record& a, const Record& b) {return (a.price > b.price) || (a.price == b.price && a.position < b.position);});
-}
+public:
+    bool Empty() const { return mLadder.Empty() && mOverflow.empty(); }
 
+    // Лучший уровень стороны и его цена; сторона не должна быть пустой.
+    PriceLevel& Best(Price& aPrice)
+    {
+        if (mLadder.Empty())
+        {
+            aPrice = mOverflow.begin()->first;
+            return mOverflow.begin()->second;
+        }
+        if constexpr (S == Side::Buy)
+            aPrice = mLadder.Highest();
+        else
+            aPrice = mLadder.Lowest();
+        if (!mOverflow.empty() && typename SideTraits<S>::Better()(mOverflow.begin()->first, aPrice))
+        {
+            aPrice = mOverflow.begin()->first;
+            return mOverflow.begin()->second;
+        }
+        return mLadder[aPrice];
+    }
 
+    // Обходит непустые уровни от лучшей цены к худшей, пока aVisit(цена, уровень)
+    // возвращает true. Уровни при обходе менять нельзя.
+    template <typename Visitor>
+    void Visit(Visitor&& aVisit)
+    {
+        typename SideTraits<S>::Better better;
+        auto overflow = mOverflow.begin();
+        bool inLadder = !mLadder.Empty();
+        Price ladderPrice = 0;
+        if (inLadder)
+            ladderPrice = S == Side::Buy ? mLadder.Highest() : mLadder.Lowest();
+        while (inLadder || overflow != mOverflow.end())
+        {
+            if (!inLadder || (overflow != mOverflow.end() && better(overflow->first, ladderPrice)))
+            {
+                if (!aVisit(overflow->first, overflow->second))
+                    return;
+                ++overflow;
+            }
+            else
+            {
+                if (!aVisit(ladderPrice, mLadder[ladderPrice]))
+                    return;
+                if constexpr (S == Side::Buy)
+                    inLadder = mLadder.Below(ladderPrice, ladderPrice);
+                else
+                    inLadder = mLadder.Above(ladderPrice, ladderPrice);
+            }
+        }
+    }
+
+    // Уровень цены aPrice, в который будет поставлена заявка. При переносе
+    // полосы уровни меняют место; aRelink(уровень) вызывается для каждого
+    // перенесенного уровня, чтобы его заявки ссылались на новое место.
+    template <typename Relink>
+    PriceLevel& Level(Price aPrice, Relink&& aRelink)
+    {
+        if (mLadder.Empty() || (!mLadder.Contains(aPrice)
+            && typename SideTraits<S>::Better()(aPrice, S == Side::Buy ? mLadder.Highest() : mLadder.Lowest())))
+            Recenter(aPrice, aRelink);
+        if (mLadder.Contains(aPrice))
+        {
+            mLadder.Set(aPrice);
+            return mLadder[aPrice];
+        }
+        return mOverflow[aPrice];
+    }
+
+    // Удаляет опустевший уровень.
+    void Erase(Price aPrice)
+    {
+        if (mLadder.Contains(aPrice))
+            mLadder.Reset(aPrice);
+        else
+            mOverflow.erase(aPrice);
+    }
+
+private:
+    static constexpr size_t LadderWidth = 4096;
+
+    PriceLadder<PriceLevel, LadderWidth> mLadder;
+    std::map<Price, PriceLevel, typename SideTraits<S>::Better,
+        RecyclingAllocator<std::pair<const Price, PriceLevel>>> mOverflow;
+    // Уровни, переносимые при смене полосы
+    std::vector<std::pair<Price, PriceLevel>> mMoved;
+
+    // Ставит полосу лестницы вокруг aPrice: уровни лестницы вне новой полосы
+    // уходят в карту, уровни карты внутри нее - в лестницу. В карте нет цен
+    // из текущей полосы, поэтому переносятся только уровни, сменившие место.
+    template <typename Relink>
+    void Recenter(Price aPrice, Relink& aRelink)
+    {
+        mMoved.clear();
+        if (!mLadder.Empty())
+        {
+            Price price = mLadder.Lowest();
+            do
+            {
+                mMoved.emplace_back(price, mLadder[price]);
+                mLadder[price] = PriceLevel();
+                mLadder.Reset(price);
+            } while (mLadder.Above(price, price));
+        }
+        Price low = aPrice - static_cast<Price>(LadderWidth / 2);
+        mLadder.SetAnchor(low);
+        // Карта упорядочена от лучшей цены: цены полосы идут подряд
+        for (auto it = mOverflow.lower_bound(S == Side::Buy ? low + static_cast<Price>(LadderWidth) - 1 : low);
+             it != mOverflow.end() && mLadder.Contains(it->first);)
+        {
+            mMoved.push_back(*it);
+            it = mOverflow.erase(it);
+        }
+        for (const auto& [price, level] : mMoved)
+        {
+            if (mLadder.Contains(price))
+            {
+                mLadder.Set(price);
+                aRelink(mLadder[price] = level);
+            }
+            else
+                aRelink(mOverflow[price] = level);
+        }
+    }
+};
+
+// Индекс ожидающих стоп-заявок стороны: очереди по цене стопа, первой идет
+// цена, которая сработает раньше других.
+template <Side S>
+using StopIndex = std::map<Price, PriceLevel,
+    std::conditional_t<S == Side::Buy, std::less<Price>, std::greater<Price>>,
+    RecyclingAllocator<std::pair<const Price, PriceLevel>>>;
+
+// Защита от ошибочных цен: полоса допустимых цен вокруг цены последней сделки
+// и остановка торгов, если цена сделок за скользящее окно сдвинулась больше
+// порога. Доли заданы в сотых долях процента, 0 - защита выключена.
+struct PriceGuard {
+    int64_t bandBps = 0;
+    int64_t haltBps = 0;
+    uint64_t windowMs = 0;
+    // Границы полосы, пересчитываются при каждой сделке
+    Price low = 0;
+    Price high = INT64_MAX;
+    // Монотонные очереди (время, цена) сделок окна: в начале - минимум и максимум окна
+    std::deque<std::pair<uint64_t, Price>> minima;
+    std::deque<std::pair<uint64_t, Price>> maxima;
+};
+
+// Стакан одного инструмента
+struct OrderBook {
+    BookSide<Side::Buy> bids;
+    BookSide<Side::Sell> asks;
+    StopIndex<Side::Buy> buyStops;
+    StopIndex<Side::Sell> sellStops;
+    // Цена последней сделки, 0 - сделок еще не было
+    Price lastPrice = 0;
+    // Наименьшая и наибольшая цена сделок с последней проверки стопов: проход
+    // по нескольким уровням может задеть стоп ценой, которая не стала последней
+    Price lowPrice = 0;
+    Price highPrice = 0;
+    // Режим аукциона: заявки копятся без сведения до снятия аукциона
+    bool auction = false;
+    // Правило распределения внутри уровня и минимальная пропорциональная доля
+    MatchingPolicy policy = MatchingPolicy::PriceTime;
+    Quantity minAllocation = 0;
+    PriceGuard guard;
+
+    // Уровни стороны S: bids для покупок, asks для продаж.
+    template <Side S>
+    auto& Levels()
+    {
+        if constexpr (S == Side::Buy)
+            return bids;
+        else
+            return asks;
+    }
+
+    template <Side S>
+    auto& Stops()
+    {
+        if constexpr (S == Side::Buy)
+            return buyStops;
+        else
+            return sellStops;
+    }
+};
 
 class Core
 {
 public:
+    Core() : mExpiry(nowMs())
+    {
+        InternSymbol(DefaultSymbol);
+        PublishSymbols();
+    }
+
     void Free()
     {
-        mUsers.clear();
-        mDeals.clear();
+        mUsers.Clear();
+        mHoldingArrays.clear();
+        mUserNames.clear();
+        mUserIds.clear();
+        mNameArena.Clear();
+        mBooks.clear();
+        mSymbolIds.clear();
+        mSymbolNames.clear();
+        mPublishedSymbols.store(0, std::memory_order_release);
+        InternSymbol(DefaultSymbol);
+        PublishSymbols();
+        mOrders.Clear();
+        mSettlement.clear();
+        mExecutions.Clear();
+        mExpiry.Clear(nowMs());
+        mDayOrders = NoOrder;
+        mNextPosition = 0;
+    }
+
+    // Снимает заявки, срок которых истек к текущему моменту.
+    void ExpireOrders()
+    {
+        mExpiry.Advance(nowMs(), [this](uint32_t aSlot) {
+            OrderNode& node = mOrders[aSlot];
+            node.timer = TimingWheel<>::NoTimer;
+            CancelResting(node);
+        });
+    }
+
+    // Конец торговой сессии: снимаются все заявки на день. Они собраны в
+    // отдельный список, стакан при этом не просматривается.
+    void EndOfSession()
+    {
+        while (mDayOrders != NoOrder)
+            CancelResting(mOrders[mDayOrders]);
     }
+
+    // Возвращает SymbolId инструмента, при первом обращении заводит для него стакан.
+    // Строка символа разбирается один раз на входе запроса, дальше работа идет по SymbolId.
+    // Стаканы заводятся только здесь, не больше MaxSymbols.
+    SymbolId InternSymbol(const std::string& aSymbol)
+    {
+        auto it = mSymbolIds.find(aSymbol);
+        if (it != mSymbolIds.end())
+            return it->second;
+        if (aSymbol.empty() || aSymbol.size() > MaxSymbolLength)
+            throw std::runtime_error("Invalid symbol.");
+        if (mBooks.size() >= MaxSymbols)
+            throw std::length_error("Too many symbols.");
+        SymbolId symbol = static_cast<SymbolId>(mBooks.size());
+        mBooks.push_back(std::make_unique<OrderBook>());
+        mSymbolIds.emplace(aSymbol, symbol);
+        mSymbolNames.push_back(aSymbol);
+        return symbol;
+    }
+
+    // Занятость пула заявок и её максимум с последнего Free.
+    size_t PoolOccupancy() const { return mOrders.Occupancy(); }
+    size_t PoolHighWaterMark() const { return mOrders.HighWaterMark(); }
     // "Регистрирует" нового пользователя и возвращает его ID.
+    // Повторная регистрация того же имени возвращает прежний ID. Имя
+    // копируется в хранилище имен один раз, индекс и таблица ссылаются на копию.
     std::string RegisterNewUser(const std::string& aUserName)
     {
-        for (auto it = mUsers.begin(); it != mUsers.end(); ++it)
+        const auto userIt = mUserIds.find(aUserName);
+        if (userIt != mUserIds.end())
         {
-            if (it->second.userName == aUserName)
-            {
-                return std::to_string(it->first);
-            }
+            return std::to_string(userIt->second);
         }
-        size_t newUserId = mUsers.size();
-        mUsers[newUserId].userName = aUserName;
-        mUsers[newUserId].usd = 0;
-        mUsers[newUserId].money = 0;
+        size_t newUserId = mUsers.Size();
+        std::string_view name = mNameArena.Intern(aUserName);
+        mUsers.EmplaceBack();
+        mUserNames.push_back(name);
+        mUserIds.emplace(name, newUserId);
 
         return std::to_string(newUserId);
     }
 
     // Запрос имени клиента по ID
-    std::string GetUserName(const std::string& aUserId)
+    std::string_view GetUserName(const std::string& aUserId)
     {
-        const auto userIt = mUsers.find(std::stoi(aUserId));
-        if (userIt == mUsers.cend())
+        int userId = FindUser(aUserId);
+        if (userId < 0)
         {
             return "Error! Unknown User";
         }
         else
         {
-            return userIt->second.userName;
+            return mUserNames[userId];
         }
     }
-    std::string GetStatus(const std::string& aUserId)
+    // Баланс по инструменту. Читает только опубликованные справочник
+    // инструментов и счета, поэтому вызывать можно и из других потоков.
+    std::string GetStatus(const std::string& aUserId, const std::string& aSymbol = DefaultSymbol) const
+    {
+        SymbolId symbol;
+        if (!FindPublishedSymbol(aSymbol, symbol))
+            return "Error! Unknown symbol";
+        int userId = FindUser(aUserId);
+        if (userId < 0)
+            return "Error! Unknown User";
+        Quantity usd;
+        Amount money;
+        ReadBalance(userId, symbol, usd, money);
+        return aSymbol + " " + formatFixed(usd, QuantityScale) + ", Money " + formatFixed(money, AmountScale);
+    }
+
+    // Позиция по инструменту и деньги счета одним согласованным снимком. Не
+    // блокирует сведение: чтение повторяется, если счет в это время менялся,
+    // поэтому вызывать можно и из других потоков.
+    void ReadBalance(size_t aUserId, SymbolId aSymbol, Quantity& aUsd, Amount& aMoney) const
     {
-        return "USD " + std::to_string(mUsers[std::stoi(aUserId)].usd) + ", Money " + std::to_string(mUsers[std::stoi(aUserId)].money);
-        // for (auto it = mDeals.begin(); it != mDeals.end(); ++it)
-        //     if (it->id == std::stoi(aUserId))
-        //         return std::to_string(it->usd) + "\n";
-        return "beep";
+        const Balance& balance = mUsers[aUserId];
+        balance.version.Read([&] {
+            const std::vector<Holding>* holdings = balance.holdings.load(std::memory_order_acquire);
+            aUsd = holdings && aSymbol < holdings->size() ? (*holdings)[aSymbol].total.Load() : 0;
+            aMoney = balance.money.Load();
+        });
+    }
+
+    // Зачисление на счет: сообщение "количество:деньги". Заявки принимаются
+    // только в пределах свободных средств, поэтому торговать можно после зачисления.
+    std::string Deposit(const std::string& aUserId, const std::string& aMessage, const std::string& aSymbol = DefaultSymbol)
+    {
+        try {
+            std::vector<size_t> delimiters = find_all(aMessage, ':');
+            if (delimiters.size() != 1)
+                return "Incorrect input\n";
+            Quantity usd = parseFixed(aMessage.substr(0, delimiters[0]), QuantityScale);
+            Amount money = parseFixed(aMessage.substr(delimiters[0] + 1), AmountScale, AmountDigits);
+            if (usd == 0 && money == 0)
+                return "Incorrect input\n";
+            int userId = FindUser(aUserId);
+            if (userId < 0)
+                return "Error! Unknown User\n";
+            Balance& balance = mUsers[userId];
+            // Стакан инструмента заводится, только если зачисляется его количество
+            Holding* holding = nullptr;
+            if (usd != 0)
+            {
+                holding = &GetHolding(balance, InternSymbol(aSymbol));
+                PublishSymbols();
+            }
+            SeqLock::Writer write(balance.version);
+            if (holding)
+                holding->total += usd;
+            balance.money += money;
+            return "Deposit accepted\n";
+        } catch (std::exception& e) {
+            return "Incorrect input\n";
+        }
     }
 
     // Добавление сделки
-    std::string AddDeal(const std::string& aUserId, const std::string& deal) {
+    std::string AddDeal(const std::string& aUserId, const std::string& deal, const DealParams& aParams = DealParams()) {
     try {
-        Record new_deal(deal); // Создаем объект Record в блоке try
+        Record new_deal(deal, aParams); // Создаем объект Record в блоке try
 
-        new_deal.id = std::stoi(aUserId);
-        new_deal.position = mDeals.size();
-        mDeals.push_back(new_deal);
-        Algorithm();
-        return "Your application is being processed\n";
+        new_deal.id = FindUser(aUserId);
+        if (new_deal.id < 0)
+            return "Error! Unknown User\n";
+        if (new_deal.expiry != 0 && new_deal.expiry != UntilEndOfDay && new_deal.expiry <= mExpiry.Now())
+            return "Incorrect input\n";
+        // Стакан нового инструмента остается, только если заявка в нем встала
+        size_t symbols = mBooks.size();
+        new_deal.symbol = InternSymbol(aParams.symbol);
+        bool newSymbol = mBooks.size() != symbols;
+        new_deal.position = mNextPosition++;
+        Outcome outcome = Algorithm(new_deal);
+        if (newSymbol && outcome != Outcome::Resting)
+            ForgetLastSymbol();
+        PublishSymbols();
+        switch (outcome)
+        {
+        case Outcome::Resting:
+            return "Your application is being processed, order id " + std::to_string(new_deal.orderId) + "\n";
+        case Outcome::Cancelled:
+            return "Order cancelled, remaining " + formatFixed(new_deal.usd, QuantityScale) + "\n";
+        case Outcome::Killed:
+            return "Order killed\n";
+        case Outcome::Rejected:
+            return "Insufficient funds\n";
+        case Outcome::Suspended:
+            return "Auction in progress\n";
+        case Outcome::WouldCross:
+            return "Post-only order would cross\n";
+        case Outcome::OutOfBand:
+            return "Price out of band\n";
+        default:
+            return "Your application is being processed\n";
+        }
     } catch (std::exception& e) {
         return "Incorrect input\n";
     }
 }
 
-private:
-    // Таблицы пользователь-баланс пользователь-сделка
-    std::map<size_t, Balance> mUsers;
-    std::list<Record> mDeals;
+    // Аукцион по инструменту: "start" переводит стакан в режим аукциона,
+    // "uncross" сводит накопленные заявки по единой цене и возвращает
+    // стакан к непрерывной торговле.
+    std::string Auction(const std::string& aCommand, const std::string& aSymbol = DefaultSymbol)
+    {
+        const auto symbolIt = mSymbolIds.find(aSymbol);
+        if (symbolIt == mSymbolIds.end())
+            return "Error! Unknown symbol\n";
+        OrderBook& book = *mBooks[symbolIt->second];
+        if (aCommand == "start")
+        {
+            book.auction = true;
+            return "Auction started\n";
+        }
+        if (aCommand != "uncross" || !book.auction)
+            return "Incorrect input\n";
+        Price price = 0;
+        Quantity volume = Uncross(book, price);
+        if (volume == 0)
+            return "Auction closed, volume 0.000000\n";
+        return "Auction closed at " + formatFixed(price, PriceScale) + ", volume " + formatFixed(volume, QuantityScale) + "\n";
+    }
 
-    void RemoveDealByPosition(int pos) 
+    // Правило сведения стакана инструмента: "price-time" или "pro-rata" с
+    // необязательной минимальной долей ("pro-rata:объем").
+    std::string SetPolicy(const std::string& aMessage, const std::string& aSymbol = DefaultSymbol)
     {
-        for (auto it = mDeals.begin(); it != mDeals.end(); ++it) {
-            if (it->position == pos) {
-                mDeals.erase(it);
-                return;
+        try {
+            const auto symbolIt = mSymbolIds.find(aSymbol);
+            if (symbolIt == mSymbolIds.end())
+                return "Error! Unknown symbol\n";
+            OrderBook& book = *mBooks[symbolIt->second];
+            std::vector<size_t> delimiters = find_all(aMessage, ':');
+            std::string name = aMessage.substr(0, delimiters.empty() ? aMessage.size() : delimiters[0]);
+            if (name == "price-time" && delimiters.empty())
+            {
+                book.policy = MatchingPolicy::PriceTime;
+                book.minAllocation = 0;
+            }
+            else if (name == "pro-rata" && delimiters.size() <= 1)
+            {
+                book.policy = MatchingPolicy::ProRata;
+                book.minAllocation = delimiters.empty() ? 0 : parseFixed(aMessage.substr(delimiters[0] + 1), QuantityScale);
             }
+            else
+                return "Incorrect input\n";
+            return "Policy set\n";
+        } catch (std::exception& e) {
+            return "Incorrect input\n";
         }
     }
 
-    void ChangeDealByPosition(int pos, double diff) 
+    // Защита стакана от ошибочных цен: сообщение "полоса%:остановка%:окно_мс"
+    // или "off". Полоса отсчитывается от цены последней сделки.
+    std::string SetPriceGuard(const std::string& aMessage, const std::string& aSymbol = DefaultSymbol)
     {
-        for (auto it = mDeals.begin(); it != mDeals.end(); ++it) {
-            if (it->position == pos) {
-                it->usd -= diff;
+        try {
+            const auto symbolIt = mSymbolIds.find(aSymbol);
+            if (symbolIt == mSymbolIds.end())
+                return "Error! Unknown symbol\n";
+            OrderBook& book = *mBooks[symbolIt->second];
+            PriceGuard& guard = book.guard;
+            if (aMessage == "off")
+            {
+                guard = PriceGuard();
+                return "Price bands off\n";
+            }
+            std::vector<size_t> delimiters = find_all(aMessage, ':');
+            if (delimiters.size() != 2)
+                return "Incorrect input\n";
+            guard.bandBps = parseFixed(aMessage.substr(0, delimiters[0]), 100, 3);
+            guard.haltBps = parseFixed(aMessage.substr(delimiters[0] + 1, delimiters[1] - delimiters[0] - 1), 100, 3);
+            guard.windowMs = parseFixed(aMessage.substr(delimiters[1] + 1), 1, 10);
+            ResetGuard(book);
+            return "Price bands set\n";
+        } catch (std::exception& e) {
+            return "Incorrect input\n";
+        }
+    }
+
+    // Отчеты об исполнении с номерами не меньше aFrom, в которых участвовал
+    // пользователь, по строке на сделку.
+    std::string GetExecutions(const std::string& aUserId, const std::string& aFrom)
+    {
+        try {
+            int userId = FindUser(aUserId);
+            if (userId < 0)
+                return "Error! Unknown User\n";
+            std::string reply;
+            mExecutions.Visit(std::stoull(aFrom), [&](uint64_t aSequence, const ExecutionReport& aReport) {
+                if (aReport.taker == userId || aReport.maker == userId)
+                    reply += "Execution " + std::to_string(aSequence) + ": " + mSymbolNames[aReport.symbol] + " "
+                        + formatFixed(aReport.usd, QuantityScale) + " at " + formatFixed(aReport.price, PriceScale)
+                        + ", taker " + std::to_string(aReport.taker) + ", maker " + std::to_string(aReport.maker)
+                        + ", remaining " + formatFixed(aReport.remaining, QuantityScale) + "\n";
+                return true;
+            });
+            return reply.empty() ? "No executions\n" : reply;
+        } catch (std::exception& e) {
+            return "Incorrect input\n";
+        }
+    }
+
+    // Снятие стоящей заявки её владельцем
+    std::string CancelDeal(const std::string& aUserId, const std::string& aOrderId)
+    {
+        try {
+            int userId = FindUser(aUserId);
+            if (userId < 0)
+                return "Error! Unknown User\n";
+            OrderNode* node = FindOrder(std::stoull(aOrderId));
+            if (!node || node->record.id != userId)
+                return "Unknown order\n";
+            CancelResting(*node);
+            return "Order cancelled\n";
+        } catch (std::exception& e) {
+            return "Incorrect input\n";
+        }
+    }
+
+    // Снимает все стоящие заявки пользователя, проходя только по его списку заявок.
+    void CancelUserDeals(const std::string& aUserId)
+    {
+        try {
+            int userId = FindUser(aUserId);
+            if (userId < 0)
                 return;
+            while (mUsers[userId].orders != NoOrder)
+                CancelResting(mOrders[mUsers[userId].orders]);
+        } catch (std::exception& e) {
+            std::cerr << e.what() << '\n';
+        }
+    }
+
+    // Изменение заявки: сообщение "id:объем:цена". Уменьшение объема без смены
+    // цены сохраняет место в очереди, иначе заявка встает в очередь заново.
+    std::string AmendDeal(const std::string& aUserId, const std::string& aMessage)
+    {
+        try {
+            int userId = FindUser(aUserId);
+            if (userId < 0)
+                return "Error! Unknown User\n";
+            std::vector<size_t> delimiters = find_all(aMessage, ':');
+            if (delimiters.size() != 2)
+                return "Incorrect input\n";
+            OrderId orderId = std::stoull(aMessage.substr(0, delimiters[0]));
+            Quantity usd = parseFixed(aMessage.substr(delimiters[0] + 1, delimiters[1] - delimiters[0] - 1), QuantityScale);
+            Price price = parseFixed(aMessage.substr(delimiters[1] + 1), PriceScale);
+            if (usd == 0 || price == 0)
+                return "Incorrect input\n";
+
+            OrderNode* node = FindOrder(orderId);
+            if (!node || node->record.id != userId)
+                return "Unknown order\n";
+            // Ожидающая стоп-заявка не стоит в стакане, менять её нельзя
+            if (node->record.stopPrice != 0)
+                return "Incorrect input\n";
+            OrderBook& book = *mBooks[node->record.symbol];
+            if (price != node->record.price && !InBand(book, price))
+                return "Price out of band\n";
+            if (node->record.postOnly && !book.auction && (node->record.side == Side::Buy
+                ? WouldCross<Side::Buy>(book, price) : WouldCross<Side::Sell>(book, price)))
+                return "Post-only order would cross\n";
+            // У айсберга объем - вся заявка вместе со скрытой частью,
+            // уменьшение сначала забирает скрытый резерв.
+            Quantity total = node->record.usd + node->record.hidden;
+            if (price == node->record.price && usd <= total)
+            {
+                Release(node->record, total - usd);
+                Quantity fromHidden = std::min(total - usd, node->record.hidden);
+                node->record.hidden -= fromHidden;
+                node->level->hidden -= fromHidden;
+                node->level->total -= total - usd - fromHidden;
+                node->record.usd -= total - usd - fromHidden;
+                return "Order amended\n";
+            }
+
+            // Резерв переносится на новые условия; если средств не хватает, заявка не меняется
+            Record amended = node->record;
+            amended.usd = usd;
+            amended.price = price;
+            Release(node->record, total);
+            if (!Reserve(amended, usd))
+            {
+                Reserve(node->record, total);
+                return "Insufficient funds\n";
             }
+
+            Detach(*node);
+            node->record.usd = usd;
+            node->record.hidden = 0;
+            node->record.price = price;
+            node->record.position = mNextPosition++;
+            if (node->record.side == Side::Buy)
+                Requeue<Side::Buy>(book, SlotOf(orderId));
+            else
+                Requeue<Side::Sell>(book, SlotOf(orderId));
+            ProcessTriggers(book);
+            return "Order amended\n";
+        } catch (std::exception& e) {
+            return "Incorrect input\n";
         }
     }
 
-    void Algorithm()
+private:
+    static constexpr size_t MaxSymbolLength = 16;
+    // Стакан занимает около 200 КБ, число инструментов ограничено
+    static constexpr size_t MaxSymbols = 64;
+
+    // Справочник инструментов для читателей из других потоков: имя пишется
+    // один раз перед публикацией и не меняется до Free.
+    std::array<std::array<char, MaxSymbolLength + 1>, MaxSymbols> mPublishedNames{};
+    std::atomic<size_t> mPublishedSymbols{0};
+
+    // Счета по ID пользователя: ID выдаются подряд, таблица плотная и не
+    // перемещает счета при росте. Имена лежат в отдельной таблице с тем же
+    // индексом. Стаканы инструментов по SymbolId.
+    StableTable<Balance> mUsers;
+    // Все массивы позиций, в том числе замененные при росте
+    std::vector<std::unique_ptr<std::vector<Holding>>> mHoldingArrays;
+    std::vector<std::string_view> mUserNames;
+    // Индекс имен: имя -> ID. Имена хранятся один раз в mNameArena.
+    std::unordered_map<std::string_view, size_t, std::hash<std::string_view>, std::equal_to<std::string_view>,
+        RecyclingAllocator<std::pair<const std::string_view, size_t>>> mUserIds;
+    StringArena<> mNameArena;
+    std::vector<std::unique_ptr<OrderBook>> mBooks;
+    // Справочник символов: имя -> SymbolId и обратно
+    std::unordered_map<std::string, SymbolId> mSymbolIds;
+    std::vector<std::string> mSymbolNames;
+    // Поток отчетов об исполнении для всех потребителей
+    EventRing<ExecutionReport> mExecutions;
+    // Изменения счетов текущего прохода сведения, память переиспользуется
+    std::vector<SettlementDelta> mSettlement;
+    // Пул стоящих заявок, номер слота входит в OrderId
+    ObjectPool<OrderNode> mOrders;
+    // Уровни в зоне пересечения при расчете цены аукциона, память переиспользуется
+    std::vector<std::pair<Price, Quantity>> mAuctionBids;
+    std::vector<std::pair<Price, Quantity>> mAuctionAsks;
+    // Таймеры истечения срочных заявок и список заявок на день
+    TimingWheel<> mExpiry;
+    uint32_t mDayOrders = NoOrder;
+    // Порядковый номер следующей заявки, задаёт приоритет по времени внутри уровня.
+    uint64_t mNextPosition = 0;
+
+    // Делает заведенные инструменты видимыми для FindPublishedSymbol.
+    void PublishSymbols()
     {
-        if (mDeals.back().side == "sell")
+        for (size_t symbol = mPublishedSymbols.load(std::memory_order_relaxed); symbol < mSymbolNames.size(); ++symbol)
         {
-            std::list<Record> buyOrders = filterBuyOrders(mDeals);
-            sortOrdersByPriceDescending(buyOrders);
+            std::array<char, MaxSymbolLength + 1>& name = mPublishedNames[symbol];
+            name[mSymbolNames[symbol].copy(name.data(), MaxSymbolLength)] = '\0';
+        }
+        mPublishedSymbols.store(mSymbolNames.size(), std::memory_order_release);
+    }
 
-            for (auto it = buyOrders.begin(); it != buyOrders.end(); ++it){
-                if (mDeals.back().price > it->price)
-                    break;
+    // SymbolId опубликованного инструмента; false, если такого нет.
+    bool FindPublishedSymbol(const std::string& aSymbol, SymbolId& aSymbolId) const
+    {
+        size_t count = mPublishedSymbols.load(std::memory_order_acquire);
+        for (size_t symbol = 0; symbol < count; ++symbol)
+            if (aSymbol == mPublishedNames[symbol].data())
+            {
+                aSymbolId = static_cast<SymbolId>(symbol);
+                return true;
+            }
+        return false;
+    }
 
-                else {
-                    if (it->usd < mDeals.back().usd)
-                    {
-                        mUsers[it->id].usd  += it->usd;
-                        mUsers[mDeals.back().id].usd -= it->usd;
-                        mUsers[it->id].money  -= it->usd * it->price;
-                        mUsers[mDeals.back().id].money += it->usd * it->price;
-
-                        mDeals.back().usd -= it->usd;
-                        RemoveDealByPosition(it->position);
-                        
-                    }
+    // Убирает последний заведенный инструмент, в стакане которого ничего не встало.
+    void ForgetLastSymbol()
+    {
+        mSymbolIds.erase(mSymbolNames.back());
+        mSymbolNames.pop_back();
+        mBooks.pop_back();
+    }
 
-                    else if (it->usd > mDeals.back().usd)
-                    {
-                        mUsers[it->id].usd  += mDeals.back().usd;
-                        mUsers[mDeals.back().id].usd -= mDeals.back().usd;
-                        mUsers[it->id].money -= mDeals.back().usd * it->price;
-                        mUsers[mDeals.back().id].money += mDeals.back().usd * it->price;
+    // Индекс счета по строковому ID или -1, если такого пользователя нет.
+    int FindUser(const std::string& aUserId) const
+    {
+        try {
+            int userId = std::stoi(aUserId);
+            return userId >= 0 && static_cast<size_t>(userId) < mUsers.Size() ? userId : -1;
+        } catch (std::exception& e) {
+            return -1;
+        }
+    }
 
-                        ChangeDealByPosition(it->position, mDeals.back().usd);
-                        mDeals.pop_back();
-                        break;
-                    }
+    static uint32_t SlotOf(OrderId aOrderId) { return static_cast<uint32_t>(aOrderId); }
+    static uint32_t GenerationOf(OrderId aOrderId) { return static_cast<uint32_t>(aOrderId >> 32); }
 
-                    else if (it -> usd == mDeals.back().usd)
-                    {
-                        mUsers[it->id].usd  += it->usd;
-                        mUsers[mDeals.back().id].usd -= it->usd;
-                        mUsers[it->id].money  -= it->usd * it->price;
-                        mUsers[mDeals.back().id].money += it->usd * it->price;
+    // Возвращает стоящую заявку или nullptr, если такой заявки уже нет.
+    OrderNode* FindOrder(OrderId aOrderId)
+    {
+        uint32_t slot = SlotOf(aOrderId);
+        if (slot >= mOrders.Capacity())
+            return nullptr;
+        OrderNode& node = mOrders[slot];
+        if (!node.resting || node.generation != GenerationOf(aOrderId))
+            return nullptr;
+        return &node;
+    }
 
-                        RemoveDealByPosition(it->position);
-                        mDeals.pop_back();
-                        break;
-                    }
-                }
+    // Ставит заявку из слота aSlot в конец очереди aQueue.
+    void Enqueue(PriceLevel& aQueue, uint32_t aSlot)
+    {
+        OrderNode& node = mOrders[aSlot];
+        node.level = &aQueue;
+        aQueue.total += node.record.usd;
+        aQueue.hidden += node.record.hidden;
+        node.prev = aQueue.tail;
+        node.next = NoOrder;
+        if (aQueue.tail != NoOrder)
+            mOrders[aQueue.tail].next = aSlot;
+        else
+            aQueue.head = aSlot;
+        aQueue.tail = aSlot;
+    }
+
+    // Ставит заявку из слота aSlot в конец очереди её ценового уровня.
+    template <Side S>
+    void Link(OrderBook& aBook, uint32_t aSlot)
+    {
+        PriceLevel& level = aBook.Levels<S>().Level(mOrders[aSlot].record.price, [this](PriceLevel& aMoved) {
+            for (uint32_t slot = aMoved.head; slot != NoOrder; slot = mOrders[slot].next)
+                mOrders[slot].level = &aMoved;
+        });
+        Enqueue(level, aSlot);
+    }
+
+    // Ставит остаток заявки в конец очереди её уровня и выдаёт ей OrderId.
+    template <Side S>
+    OrderId RestDeal(OrderBook& aBook, Record& aDeal)
+    {
+        uint32_t slot = AcquireOrder(aDeal);
+        Link<S>(aBook, slot);
+        return aDeal.orderId;
+    }
+
+    // Ставит стоп-заявку в очередь её цены стопа и выдаёт ей OrderId.
+    template <Side S>
+    OrderId PendDeal(OrderBook& aBook, Record& aDeal)
+    {
+        uint32_t slot = AcquireOrder(aDeal);
+        Enqueue(aBook.Stops<S>()[aDeal.stopPrice], slot);
+        return aDeal.orderId;
+    }
+
+    // Занимает слот под заявку и вносит её в список заявок пользователя,
+    // срочной заявке ставится таймер, заявка на день вносится в список дня.
+    uint32_t AcquireOrder(Record& aDeal)
+    {
+        uint32_t slot = mOrders.Acquire();
+        OrderNode& node = mOrders[slot];
+        aDeal.orderId = (static_cast<OrderId>(node.generation) << 32) | slot;
+        node.record = aDeal;
+        node.resting = true;
+
+        uint32_t& orders = mUsers[aDeal.id].orders;
+        node.userPrev = NoOrder;
+        node.userNext = orders;
+        if (orders != NoOrder)
+            mOrders[orders].userPrev = slot;
+        orders = slot;
+
+        if (aDeal.expiry == UntilEndOfDay)
+        {
+            node.dayPrev = NoOrder;
+            node.dayNext = mDayOrders;
+            if (mDayOrders != NoOrder)
+                mOrders[mDayOrders].dayPrev = slot;
+            mDayOrders = slot;
+        }
+        else if (aDeal.expiry != 0)
+            node.timer = mExpiry.Schedule(aDeal.expiry, slot);
+        return slot;
+    }
+
+    // Исключает узел из очереди уровня.
+    void Unlink(PriceLevel& aQueue, OrderNode& aNode)
+    {
+        if (aNode.prev != NoOrder)
+            mOrders[aNode.prev].next = aNode.next;
+        else
+            aQueue.head = aNode.next;
+        if (aNode.next != NoOrder)
+            mOrders[aNode.next].prev = aNode.prev;
+        else
+            aQueue.tail = aNode.prev;
+    }
+
+    // Исключает заявку из очереди, опустевший уровень удаляется. Слот остается занятым.
+    void Detach(OrderNode& aNode)
+    {
+        aNode.level->total -= aNode.record.usd;
+        aNode.level->hidden -= aNode.record.hidden;
+        Unlink(*aNode.level, aNode);
+        if (aNode.level->head == NoOrder)
+        {
+            OrderBook& book = *mBooks[aNode.record.symbol];
+            if (aNode.record.stopPrice != 0)
+            {
+                if (aNode.record.side == Side::Buy)
+                    book.buyStops.erase(aNode.record.stopPrice);
+                else
+                    book.sellStops.erase(aNode.record.stopPrice);
             }
+            else if (aNode.record.side == Side::Buy)
+                book.bids.Erase(aNode.record.price);
+            else
+                book.asks.Erase(aNode.record.price);
         }
-        else if (mDeals.back().side == "buy")
+        aNode.level = nullptr;
+    }
+
+    // Возвращает слот в пул; OrderId заявки становится недействительным.
+    void ReleaseOrder(uint32_t aSlot)
+    {
+        OrderNode& node = mOrders[aSlot];
+        if (node.userPrev != NoOrder)
+            mOrders[node.userPrev].userNext = node.userNext;
+        else
+            mUsers[node.record.id].orders = node.userNext;
+        if (node.userNext != NoOrder)
+            mOrders[node.userNext].userPrev = node.userPrev;
+        if (node.record.expiry == UntilEndOfDay)
+        {
+            if (node.dayPrev != NoOrder)
+                mOrders[node.dayPrev].dayNext = node.dayNext;
+            else
+                mDayOrders = node.dayNext;
+            if (node.dayNext != NoOrder)
+                mOrders[node.dayNext].dayPrev = node.dayPrev;
+        }
+        else if (node.timer != TimingWheel<>::NoTimer)
         {
-            std::list<Record> sellOrders = filterSellOrders(mDeals);
-            sortOrdersByPriceAscending(sellOrders);
+            mExpiry.Cancel(node.timer);
+            node.timer = TimingWheel<>::NoTimer;
+        }
+        node.resting = false;
+        ++node.generation;
+        mOrders.Release(aSlot);
+    }
 
-            for (auto it = sellOrders.begin(); it != sellOrders.end(); ++it) {
-                if (it->price > mDeals.back().price)
-                    break;
+    // Снимает заявку из стакана; опустевший уровень удаляется.
+    void RemoveDealById(OrderId aOrderId)
+    {
+        OrderNode* node = FindOrder(aOrderId);
+        if (!node)
+            return;
+        Detach(*node);
+        ReleaseOrder(SlotOf(aOrderId));
+    }
 
-                else {
-                    if (it->usd < mDeals.back().usd)
-                    {
-                        mUsers[it->id].usd  -= it->usd;
-                        mUsers[mDeals.back().id].usd += it->usd;
-                        mUsers[it->id].money  += it->usd * it->price;
-                        mUsers[mDeals.back().id].money -= it->usd * it->price;
+    // Снимает стоящую заявку и освобождает резерв под её остаток.
+    void CancelResting(OrderNode& aNode)
+    {
+        Release(aNode.record, aNode.record.usd + aNode.record.hidden);
+        RemoveDealById(aNode.record.orderId);
+    }
 
-                        mDeals.back().usd -= it->usd;
-                        RemoveDealByPosition(it->position);
-                    }
+    // Уменьшает объём заявки на aDiff, полностью исполненная заявка снимается.
+    // У исполненной видимой части айсберга объем пополняется из скрытого резерва.
+    void ChangeDealById(OrderId aOrderId, Quantity aDiff)
+    {
+        OrderNode* node = FindOrder(aOrderId);
+        if (!node)
+            return;
+        node->record.usd -= aDiff;
+        node->level->total -= aDiff;
+        if (node->record.usd > 0)
+            return;
+        if (node->record.hidden > 0)
+            Refresh(SlotOf(aOrderId));
+        else
+            RemoveDealById(aOrderId);
+    }
 
-                    else if (it -> usd > mDeals.back().usd)
-                    {
-                        mUsers[it->id].usd  -= mDeals.back().usd;
-                        mUsers[mDeals.back().id].usd += mDeals.back().usd;
-                        mUsers[it->id].money += mDeals.back().usd * it->price;
-                        mUsers[mDeals.back().id].money -= mDeals.back().usd * it->price;
+    // Показывает следующую часть айсберга. Заявка теряет приоритет по времени и
+    // переходит в конец очереди своего уровня, слот и OrderId не меняются.
+    void Refresh(uint32_t aSlot)
+    {
+        OrderNode& node = mOrders[aSlot];
+        PriceLevel& level = *node.level;
+        level.hidden -= node.record.hidden;
+        Unlink(level, node);
+        node.record.usd = std::min(node.record.peak, node.record.hidden);
+        node.record.hidden -= node.record.usd;
+        node.record.position = mNextPosition++;
+        Enqueue(level, aSlot);
+    }
 
-                        ChangeDealByPosition(it->position, mDeals.back().usd);
-                        mDeals.pop_back();
-                        break;
-                    }
+    // Оставляет в стакане видимым не больше пика айсберга, остальное уходит в резерв.
+    static void Display(Record& aDeal)
+    {
+        if (aDeal.peak != 0 && aDeal.usd > aDeal.peak)
+        {
+            aDeal.hidden = aDeal.usd - aDeal.peak;
+            aDeal.usd = aDeal.peak;
+        }
+    }
 
-                    else if (it -> usd == mDeals.back().usd)
-                    {
-                        mUsers[it->id].usd  -= it->usd;
-                        mUsers[mDeals.back().id].usd += it->usd;
-                        mUsers[it->id].money  += it->usd * it->price;
-                        mUsers[mDeals.back().id].money -= it->usd * it->price;
+    // Позиция счета по инструменту aSymbol; заводится при первом обращении.
+    // Массив позиций растет копированием с запасом, копия публикуется целиком.
+    Holding& GetHolding(Balance& aBalance, SymbolId aSymbol)
+    {
+        std::vector<Holding>* holdings = aBalance.holdings.load(std::memory_order_relaxed);
+        if (!holdings || holdings->size() <= aSymbol)
+        {
+            size_t size = holdings ? std::max<size_t>(holdings->size() * 2, aSymbol + 1) : aSymbol + 1;
+            auto grown = std::make_unique<std::vector<Holding>>(size);
+            if (holdings)
+                std::copy(holdings->begin(), holdings->end(), grown->begin());
+            holdings = grown.get();
+            mHoldingArrays.push_back(std::move(grown));
+            aBalance.holdings.store(holdings, std::memory_order_release);
+        }
+        return (*holdings)[aSymbol];
+    }
+
+    // Резервирует средства под aUsd заявки: деньги по цене заявки для покупки,
+    // сам инструмент для продажи. Зарезервировать больше свободного остатка
+    // нельзя. Рыночная покупка не резервирует, её проверяет Affordable.
+    bool Reserve(const Record& aDeal, Quantity aUsd)
+    {
+        Balance& balance = mUsers[aDeal.id];
+        if (aDeal.side == Side::Buy)
+        {
+            Amount need = aUsd * reservePrice(aDeal);
+            if (balance.money - balance.reservedMoney < need)
+                return false;
+            balance.reservedMoney += need;
+        }
+        else
+        {
+            Holding& holding = GetHolding(balance, aDeal.symbol);
+            if (holding.total - holding.reserved < aUsd)
+                return false;
+            holding.reserved += aUsd;
+        }
+        return true;
+    }
+
+    // Хватает ли свободных денег на рыночную покупку: её стоимость по встречным
+    // уровням в пределах цены заявки, вместе со скрытыми частями, не больше
+    // свободного остатка. Рыночная заявка не встает в стакан и сводится сразу.
+    bool Affordable(OrderBook& aBook, const Record& aDeal)
+    {
+        const Balance& balance = mUsers[aDeal.id];
+        Amount cost = 0;
+        Quantity left = aDeal.usd;
+        aBook.asks.Visit([&](Price aPrice, const PriceLevel& aLevel) {
+            if (aPrice > aDeal.price)
+                return false;
+            Quantity usd = std::min(left, aLevel.total + aLevel.hidden);
+            cost += usd * aPrice;
+            left -= usd;
+            return left > 0;
+        });
+        return balance.money - balance.reservedMoney >= cost;
+    }
+
+    // Освобождает резерв под aUsd заявки, которые уже не будут исполнены.
+    void Release(const Record& aDeal, Quantity aUsd)
+    {
+        Balance& balance = mUsers[aDeal.id];
+        if (aDeal.side == Side::Buy)
+            balance.reservedMoney -= aUsd * reservePrice(aDeal);
+        else
+            GetHolding(balance, aDeal.symbol).reserved -= aUsd;
+    }
+
+    // Сделка на aUsd между покупкой и продажей по цене aPrice. Резервы обеих
+    // заявок под исполненный объем расходуются. Счета не меняются сразу:
+    // изменения копятся до ApplySettlement, сделки одного счета (обычно
+    // входящей заявки) складываются в одну запись.
+    void Settle(const Record& aBuy, const Record& aSell, Quantity aUsd, Price aPrice)
+    {
+        Amount cost = aUsd * aPrice;
+        SettlementDelta& buyer = PendingDelta(aBuy);
+        buyer.total += aUsd;
+        buyer.money -= cost;
+        buyer.reservedMoney -= aUsd * reservePrice(aBuy);
+        // Запись покупателя больше не нужна: добавление может переместить буфер
+        SettlementDelta& seller = PendingDelta(aSell);
+        seller.total -= aUsd;
+        seller.reserved -= aUsd;
+        seller.money += cost;
+    }
+
+    // Запись изменений счета заявки в текущем проходе; заводится при первой сделке.
+    SettlementDelta& PendingDelta(const Record& aDeal)
+    {
+        uint32_t& pending = mUsers[aDeal.id].pending;
+        if (pending == NoOrder)
+        {
+            pending = static_cast<uint32_t>(mSettlement.size());
+            mSettlement.emplace_back();
+            mSettlement.back().user = aDeal.id;
+            mSettlement.back().symbol = aDeal.symbol;
+        }
+        return mSettlement[pending];
+    }
+
+    // Применяет изменения прохода: каждый счет меняется один раз под своей
+    // версией, читатели видят счет до прохода или после него целиком.
+    void ApplySettlement()
+    {
+        for (const SettlementDelta& delta : mSettlement)
+        {
+            Balance& balance = mUsers[delta.user];
+            Holding& holding = GetHolding(balance, delta.symbol);
+            SeqLock::Writer write(balance.version);
+            holding.total += delta.total;
+            holding.reserved += delta.reserved;
+            balance.money += delta.money;
+            balance.reservedMoney += delta.reservedMoney;
+            balance.pending = NoOrder;
+        }
+        mSettlement.clear();
+    }
+
+    // Ядро сведения для входящей заявки стороны S: проходит пересекающиеся уровни
+    // встречной стороны, пока заявка не исполнена. Встреча со своей же заявкой
+    // обрабатывается по режиму STP входящей; возвращает false, если по нему
+    // снят остаток входящей заявки. Счета меняются один раз в конце прохода.
+    template <Side S>
+    bool Match(OrderBook& aBook, Record& aDeal)
+    {
+        using Traits = SideTraits<S>;
+        auto& opposite = aBook.Levels<Traits::Opposite>();
+        // Остановка торгов прерывает проход, остаток обрабатывается как в аукционе
+        while (aDeal.usd > 0 && !opposite.Empty() && !aBook.auction)
+        {
+            Price bestPrice;
+            PriceLevel& level = opposite.Best(bestPrice);
+            if (!Traits::Crosses(aDeal.price, bestPrice))
+                break;
+
+            // Пропорциональное распределение нужно, только если уровень
+            // исполняется не целиком; уровень со своей заявкой при STP
+            // сводится по времени.
+            if (__builtin_expect(aBook.policy == MatchingPolicy::ProRata, 0)
+                && aDeal.usd < level.total && (aDeal.stp == StpMode::None || !HasOrderOf(level, aDeal.id)))
+            {
+                AllocateProRata<S>(aBook, aDeal, level);
+                break;
+            }
+
+            OrderNode& node = mOrders[level.head];
+            Record& resting = node.record;
+            if (__builtin_expect(resting.id == aDeal.id, 0) && aDeal.stp != StpMode::None)
+            {
+                if (aDeal.stp == StpMode::CancelNewest)
+                {
+                    ApplySettlement();
+                    return false;
+                }
+                if (aDeal.stp == StpMode::CancelOldest)
+                {
+                    CancelResting(node);
+                    continue;
+                }
+                Quantity decrement = std::min(resting.usd, aDeal.usd);
+                Release(aDeal, decrement);
+                aDeal.usd -= decrement;
+                Release(resting, decrement);
+                ChangeDealById(resting.orderId, decrement);
+                continue;
+            }
+
+            Trade<S>(aBook, aDeal, resting, std::min(resting.usd, aDeal.usd));
+        }
+        ApplySettlement();
+        return true;
+    }
+
+    // Сделка входящей заявки стороны S со стоящей на aUsd по цене стоящей.
+    template <Side S>
+    void Trade(OrderBook& aBook, Record& aDeal, Record& aResting, Quantity aUsd)
+    {
+        using Traits = SideTraits<S>;
+        Settle(Traits::Buyer(aDeal, aResting), Traits::Seller(aDeal, aResting), aUsd, aResting.price);
+        RecordPrice(aBook, aResting.price);
+        UpdateGuard(aBook);
+        aDeal.usd -= aUsd;
+        Report(aDeal, aResting, aUsd, aResting.price, aDeal.usd);
+        ChangeDealById(aResting.orderId, aUsd);
+    }
+
+    // Цена сделки становится последней и расширяет диапазон цен для стопов.
+    static void RecordPrice(OrderBook& aBook, Price aPrice)
+    {
+        aBook.lastPrice = aPrice;
+        aBook.lowPrice = aBook.lowPrice == 0 ? aPrice : std::min(aBook.lowPrice, aPrice);
+        aBook.highPrice = std::max(aBook.highPrice, aPrice);
+    }
+
+    // Записывает отчет о сделке в поток исполнений.
+    void Report(const Record& aTaker, const Record& aMaker, Quantity aUsd, Price aPrice, Quantity aRemaining)
+    {
+        ExecutionReport report;
+        report.symbol = aTaker.symbol;
+        report.taker = aTaker.id;
+        report.maker = aMaker.id;
+        report.takerOrder = aTaker.orderId;
+        report.makerOrder = aMaker.orderId;
+        report.price = aPrice;
+        report.usd = aUsd;
+        report.remaining = aRemaining;
+        mExecutions.Push(report);
+    }
+
+    // Стоит ли на уровне заявка пользователя aUserId.
+    bool HasOrderOf(const PriceLevel& aLevel, int aUserId) const
+    {
+        for (uint32_t slot = aLevel.head; slot != NoOrder; slot = mOrders[slot].next)
+            if (mOrders[slot].record.id == aUserId)
+                return true;
+        return false;
+    }
+
+    // Распределяет объем входящей заявки (меньший объема уровня) между заявками
+    // уровня пропорционально их видимому объему по суммарному объему уровня.
+    // Доли меньше минимальной не выделяются, остаток от округления и таких
+    // долей раздается по очереди уровня. Доля меньше объема заявки, поэтому
+    // первый проход не снимает заявок из очереди. Остановка торгов прерывает
+    // распределение, как и проход по уровням.
+    template <Side S>
+    void AllocateProRata(OrderBook& aBook, Record& aDeal, PriceLevel& aLevel)
+    {
+        Quantity incoming = aDeal.usd;
+        Quantity total = aLevel.total;
+        for (uint32_t slot = aLevel.head; slot != NoOrder && !aBook.auction; slot = mOrders[slot].next)
+        {
+            Record& resting = mOrders[slot].record;
+            Quantity share = static_cast<Quantity>(static_cast<__int128>(incoming) * resting.usd / total);
+            if (share > 0 && share >= aBook.minAllocation)
+                Trade<S>(aBook, aDeal, resting, share);
+        }
+        // Уровень больше оставшегося объема и не опустеет; пополненный айсберг
+        // уходит в конец очереди, поэтому обход при необходимости идет по кругу.
+        for (uint32_t slot = aLevel.head; aDeal.usd > 0 && !aBook.auction;)
+        {
+            uint32_t next = mOrders[slot].next;
+            Record& resting = mOrders[slot].record;
+            Trade<S>(aBook, aDeal, resting, std::min(resting.usd, aDeal.usd));
+            slot = next != NoOrder ? next : aLevel.head;
+        }
+    }
 
-                        RemoveDealByPosition(it->position);
-                        mDeals.pop_back();
+    // Объем встречных заявок вместе со скрытыми частями айсбергов, доступный
+    // входящей заявке по её цене (не больше aLimit). При включенной защите STP
+    // свои заявки не считаются: для этого уровни проходятся по заявкам, а не по
+    // суммарному объему.
+    // При "cancel-newest" проход остановится на первой своей заявке: считается
+    // только объем перед ней, скрытые части её уровня пополнятся уже после нее.
+    template <Side S>
+    Quantity Available(OrderBook& aBook, const Record& aDeal, Quantity aLimit)
+    {
+        using Traits = SideTraits<S>;
+        Quantity available = 0;
+        bool blocked = false;
+        aBook.Levels<Traits::Opposite>().Visit([&](Price aPrice, const PriceLevel& aLevel) {
+            if (!Traits::Crosses(aDeal.price, aPrice))
+                return false;
+            if (aDeal.stp == StpMode::None)
+                available += aLevel.total + aLevel.hidden;
+            else
+            {
+                Quantity hidden = 0;
+                for (uint32_t slot = aLevel.head; slot != NoOrder && available < aLimit; slot = mOrders[slot].next)
+                {
+                    const Record& resting = mOrders[slot].record;
+                    if (resting.id != aDeal.id)
+                    {
+                        available += resting.usd;
+                        hidden += resting.hidden;
+                    }
+                    else if (aDeal.stp == StpMode::CancelNewest)
+                    {
+                        blocked = true;
                         break;
                     }
                 }
+                if (!blocked)
+                    available += hidden;
             }
+            return !blocked && available < aLimit;
+        });
+        return available;
+    }
+
+    // Лежит ли цена в полосе допустимых цен стакана.
+    static bool InBand(const OrderBook& aBook, Price aPrice)
+    {
+        return aPrice >= aBook.guard.low && aPrice <= aBook.guard.high;
+    }
+
+    // Предел цены рыночной заявки стороны S - граница полосы. Без полосы это
+    // MarketPrice, пересекающая любой уровень.
+    template <Side S>
+    static Price BandLimit(const OrderBook& aBook)
+    {
+        return S == Side::Buy ? aBook.guard.high : aBook.guard.low;
+    }
+
+    // Пересчитывает полосу от цены последней сделки и начинает окно заново.
+    static void ResetGuard(OrderBook& aBook)
+    {
+        PriceGuard& guard = aBook.guard;
+        guard.minima.clear();
+        guard.maxima.clear();
+        guard.low = 0;
+        guard.high = INT64_MAX;
+        if (guard.bandBps != 0 && aBook.lastPrice != 0)
+        {
+            Price width = aBook.lastPrice * guard.bandBps / 10000;
+            guard.low = aBook.lastPrice - width;
+            guard.high = aBook.lastPrice + width;
         }
     }
+
+    // Учитывает сделку по цене aBook.lastPrice: сдвигает полосу и окно. Если
+    // максимум окна превысил минимум больше чем на порог, стакан
+    // останавливается и переходит в режим аукциона. O(1) в среднем на сделку.
+    void UpdateGuard(OrderBook& aBook)
+    {
+        PriceGuard& guard = aBook.guard;
+        Price price = aBook.lastPrice;
+        if (guard.bandBps != 0)
+        {
+            Price width = price * guard.bandBps / 10000;
+            guard.low = price - width;
+            guard.high = price + width;
+        }
+        if (guard.haltBps == 0)
+            return;
+        uint64_t now = mExpiry.Now();
+        while (!guard.minima.empty() && guard.minima.front().first + guard.windowMs < now)
+            guard.minima.pop_front();
+        while (!guard.maxima.empty() && guard.maxima.front().first + guard.windowMs < now)
+            guard.maxima.pop_front();
+        while (!guard.minima.empty() && guard.minima.back().second >= price)
+            guard.minima.pop_back();
+        while (!guard.maxima.empty() && guard.maxima.back().second <= price)
+            guard.maxima.pop_back();
+        guard.minima.emplace_back(now, price);
+        guard.maxima.emplace_back(now, price);
+        Price lowest = guard.minima.front().second;
+        Price highest = guard.maxima.front().second;
+        if (static_cast<__int128>(highest) * 10000 >= static_cast<__int128>(lowest) * (10000 + guard.haltBps))
+        {
+            aBook.auction = true;
+            guard.minima.clear();
+            guard.maxima.clear();
+        }
+    }
+
+    // Пересекает ли цена aPrice заявки стороны S лучшую встречную цену.
+    template <Side S>
+    bool WouldCross(OrderBook& aBook, Price aPrice)
+    {
+        auto& opposite = aBook.Levels<SideTraits<S>::Opposite>();
+        Price best;
+        if (opposite.Empty())
+            return false;
+        opposite.Best(best);
+        return SideTraits<S>::Crosses(aPrice, best);
+    }
+
+    // Сводит новую заявку. Остаток лимитной заявки ставится в конец очереди своего
+    // ценового уровня, остаток остальных типов снимается без выделения узла.
+    // Стоп-заявка не сводится, а ждет срабатывания в индексе стопов.
+    // Под заявку сначала резервируются средства, несостоявшийся объем их освобождает.
+    // В режиме аукциона лимитная заявка встает в стакан без сведения,
+    // немедленные заявки не принимаются. Post-only, FOK и минимальный объем
+    // проверяются по лучшей цене и суммарным объемам уровней до резервирования,
+    // так что отказ ничего не меняет.
+    template <Side S>
+    Outcome Execute(OrderBook& aBook, Record& aDeal)
+    {
+        if (aBook.auction && ((aDeal.type != OrderType::Limit && aDeal.stopPrice == 0) || aDeal.minQty != 0))
+            return Outcome::Suspended;
+        // Цена проверяется по полосе, рыночная заявка ограничивается её границей
+        if (aDeal.type == OrderType::Market)
+            aDeal.price = BandLimit<S>(aBook);
+        else if (aDeal.type != OrderType::Stop && !InBand(aBook, aDeal.price))
+            return Outcome::OutOfBand;
+        if (aDeal.postOnly && !aBook.auction && WouldCross<S>(aBook, aDeal.price))
+            return Outcome::WouldCross;
+        Quantity minimum = aDeal.type == OrderType::FillOrKill ? aDeal.usd : aDeal.minQty;
+        if (minimum != 0 && Available<S>(aBook, aDeal, minimum) < minimum)
+            return Outcome::Killed;
+        if (S == Side::Buy && aDeal.type == OrderType::Market && !Affordable(aBook, aDeal))
+            return Outcome::Rejected;
+        if (!Reserve(aDeal, aDeal.usd))
+            return Outcome::Rejected;
+        if (aDeal.stopPrice != 0)
+        {
+            PendDeal<S>(aBook, aDeal);
+            return Outcome::Resting;
+        }
+        if (aBook.auction)
+        {
+            Display(aDeal);
+            RestDeal<S>(aBook, aDeal);
+            return Outcome::Resting;
+        }
+        bool matched = Match<S>(aBook, aDeal);
+        if (aDeal.usd == 0)
+            return Outcome::Filled;
+        if (!matched || aDeal.type != OrderType::Limit)
+        {
+            Release(aDeal, aDeal.usd);
+            return Outcome::Cancelled;
+        }
+        Display(aDeal);
+        RestDeal<S>(aBook, aDeal);
+        return Outcome::Resting;
+    }
+
+    // Повторно сводит заявку из слота, уже снятую из очереди, и ставит остаток
+    // лимитной заявки обратно с прежним OrderId; остаток рыночной снимается.
+    template <Side S>
+    void Requeue(OrderBook& aBook, uint32_t aSlot)
+    {
+        Record& record = mOrders[aSlot].record;
+        // В аукционе заявка только встает в очередь
+        bool matched = aBook.auction || Match<S>(aBook, record);
+        if (matched && record.usd > 0 && record.type == OrderType::Limit)
+        {
+            Display(record);
+            Link<S>(aBook, aSlot);
+            return;
+        }
+        Release(record, record.usd);
+        ReleaseOrder(aSlot);
+    }
+
+    // Активирует первую стоп-заявку стороны S, если цена сделок с последней
+    // проверки дошла до её цены стопа: для покупки наибольшая, для продажи
+    // наименьшая. false, если срабатывать нечему. Пока торги остановлены,
+    // стопы ждут снятия аукциона.
+    template <Side S>
+    bool ActivateNext(OrderBook& aBook)
+    {
+        auto& stops = aBook.Stops<S>();
+        Price reached = S == Side::Buy ? aBook.highPrice : aBook.lowPrice;
+        if (aBook.auction || reached == 0 || stops.empty() || !SideTraits<S>::Triggers(stops.begin()->first, reached))
+            return false;
+        uint32_t slot = stops.begin()->second.head;
+        Record& record = mOrders[slot].record;
+        Detach(mOrders[slot]);
+        record.stopPrice = 0;
+        if (record.type == OrderType::Stop)
+        {
+            record.type = OrderType::Market;
+            record.price = BandLimit<S>(aBook);
+            // Стоп-покупка без резерва, на которую не хватает денег, снимается
+            if (S == Side::Buy && !Affordable(aBook, record))
+            {
+                Release(record, record.usd);
+                ReleaseOrder(slot);
+                return true;
+            }
+        }
+        else
+            record.type = OrderType::Limit;
+        record.position = mNextPosition++;
+        Requeue<S>(aBook, slot);
+        return true;
+    }
+
+    // Активирует сработавшие стопы после сделок. Просматриваются только начала
+    // индексов: стоп-покупки от меньшей цены стопа, затем стоп-продажи от большей,
+    // внутри цены - по времени. Сделки активированной заявки двигают цену, и
+    // проверка повторяется, пока срабатывать нечему.
+    void ProcessTriggers(OrderBook& aBook)
+    {
+        while (ActivateNext<Side::Buy>(aBook) || ActivateNext<Side::Sell>(aBook))
+        {
+        }
+        // Диапазон прохода учтен; при остановке торгов он ждет снятия аукциона
+        if (!aBook.auction)
+            aBook.lowPrice = aBook.highPrice = aBook.lastPrice;
+    }
+
+    // Цена аукциона - цена уровня, при которой исполняется наибольший объем.
+    // Уровни обеих сторон из зоны пересечения сливаются по возрастанию цены,
+    // накопленные объемы продаж не дороже цены и покупок не дешевле цены
+    // считаются одним проходом. При равном объеме выбирается меньший дисбаланс,
+    // затем цена ближе к цене последней сделки, затем меньшая. Возвращает
+    // исполняемый объем, 0 - стакан не пересекается.
+    Quantity ClearingPrice(OrderBook& aBook, Price& aPrice)
+    {
+        if (aBook.bids.Empty() || aBook.asks.Empty())
+            return 0;
+        Price bestBid;
+        Price bestAsk;
+        aBook.bids.Best(bestBid);
+        aBook.asks.Best(bestAsk);
+        if (bestBid < bestAsk)
+            return 0;
+
+        Quantity buyTotal = 0;
+        mAuctionBids.clear();
+        mAuctionAsks.clear();
+        aBook.bids.Visit([&](Price aLevelPrice, const PriceLevel& aLevel) {
+            if (aLevelPrice < bestAsk)
+                return false;
+            mAuctionBids.emplace_back(aLevelPrice, aLevel.total + aLevel.hidden);
+            buyTotal += aLevel.total + aLevel.hidden;
+            return true;
+        });
+        aBook.asks.Visit([&](Price aLevelPrice, const PriceLevel& aLevel) {
+            if (aLevelPrice > bestBid)
+                return false;
+            mAuctionAsks.emplace_back(aLevelPrice, aLevel.total + aLevel.hidden);
+            return true;
+        });
+
+        // Покупки идут по убыванию цены, поэтому проходятся с конца
+        size_t bid = mAuctionBids.size();
+        size_t ask = 0;
+        Quantity sellVolume = 0;
+        Quantity buyBelow = 0;
+        Quantity bestVolume = 0;
+        Quantity bestImbalance = 0;
+        while (bid > 0 || ask < mAuctionAsks.size())
+        {
+            Price price = bid > 0 ? mAuctionBids[bid - 1].first : INT64_MAX;
+            if (ask < mAuctionAsks.size())
+                price = std::min(price, mAuctionAsks[ask].first);
+            for (; ask < mAuctionAsks.size() && mAuctionAsks[ask].first == price; ++ask)
+                sellVolume += mAuctionAsks[ask].second;
+            Quantity buyVolume = buyTotal - buyBelow;
+            Quantity volume = std::min(buyVolume, sellVolume);
+            Quantity imbalance = buyVolume > sellVolume ? buyVolume - sellVolume : sellVolume - buyVolume;
+            if (volume > bestVolume || (volume == bestVolume && volume > 0 && (imbalance < bestImbalance
+                || (imbalance == bestImbalance && aBook.lastPrice != 0
+                    && std::abs(price - aBook.lastPrice) < std::abs(aPrice - aBook.lastPrice)))))
+            {
+                bestVolume = volume;
+                bestImbalance = imbalance;
+                aPrice = price;
+            }
+            for (; bid > 0 && mAuctionBids[bid - 1].first == price; --bid)
+                buyBelow += mAuctionBids[bid - 1].second;
+        }
+        return bestVolume;
+    }
+
+    // Снимает аукцион: все сделки проходят по цене аукциона одним проходом по
+    // лучшим заявкам обеих сторон в порядке цены и времени. Затем срабатывают
+    // стопы, задетые новой ценой.
+    Quantity Uncross(OrderBook& aBook, Price& aPrice)
+    {
+        aBook.auction = false;
+        Quantity volume = ClearingPrice(aBook, aPrice);
+        for (Quantity left = volume; left > 0;)
+        {
+            Price bidPrice;
+            Price askPrice;
+            OrderNode& bid = mOrders[aBook.bids.Best(bidPrice).head];
+            OrderNode& ask = mOrders[aBook.asks.Best(askPrice).head];
+            Quantity traded = std::min({bid.record.usd, ask.record.usd, left});
+            Settle(bid.record, ask.record, traded, aPrice);
+            // В аукционе инициатора нет, им считается покупка
+            Report(bid.record, ask.record, traded, aPrice, bid.record.usd - traded + bid.record.hidden);
+            left -= traded;
+            ChangeDealById(bid.record.orderId, traded);
+            ChangeDealById(ask.record.orderId, traded);
+        }
+        ApplySettlement();
+        if (volume > 0)
+        {
+            RecordPrice(aBook, aPrice);
+            ResetGuard(aBook);
+        }
+        ProcessTriggers(aBook);
+        return volume;
+    }
+
+    // Стоящему остатку присваивается aDeal.orderId.
+    Outcome Algorithm(Record& aDeal)
+    {
+        OrderBook& book = *mBooks[aDeal.symbol];
+        Outcome outcome = aDeal.side == Side::Buy ? Execute<Side::Buy>(book, aDeal) : Execute<Side::Sell>(book, aDeal);
+        ProcessTriggers(book);
+        return outcome;
+    }
 };
 
 Core& GetCore()
@@ -316,31 +1995,96 @@ public:
             auto j = nlohmann::json::parse(data_);
             auto reqType = j["ReqType"];
 
+            // Истекшие заявки снимаются до обработки любого запроса.
+            GetCore().ExpireOrders();
+
             std::string reply = "Error! Unknown request type";
-            if (reqType == Requests::Registration)
-            {
-                // Это реквест на регистрацию пользователя.
-                // Добавляем нового пользователя и возвращаем его ID.
-                reply = GetCore().RegisterNewUser(j["Message"]);
-            }
-            else if (reqType == Requests::Hello)
-            {
-                // Это реквест на приветствие.
-                // Находим имя пользователя по ID и приветствуем его по имени.
-                reply = "Hello, " + GetCore().GetUserName(j["UserId"]) + "!\n";
-            }
-            else if (reqType == Requests::Trading)
-            {
-                reply = GetCore().AddDeal(j["UserId"], j["Message"]);
-            }
-            else if (reqType == Requests::Status)
-            {
-                reply = GetCore().GetStatus(j["UserId"]) + "\n";
-            }
-            else if (reqType == Requests::Free)
-            {
-                GetCore().Free();
-                reply = "bibip\n";
+            // Поле неверного типа - ошибка ввода, а не исключение из сессии
+            try {
+                if (reqType == Requests::Registration)
+                {
+                    // Это реквест на регистрацию пользователя.
+                    // Добавляем нового пользователя и возвращаем его ID.
+                    reply = GetCore().RegisterNewUser(j["Message"]);
+                }
+                else if (reqType == Requests::Hello)
+                {
+                    // Это реквест на приветствие.
+                    // Находим имя пользователя по ID и приветствуем его по имени.
+                    reply = "Hello, ";
+                    reply.append(GetCore().GetUserName(j["UserId"])).append("!\n");
+                }
+                else if (reqType == Requests::Trading)
+                {
+                    DealParams params;
+                    params.symbol = j.value("Symbol", params.symbol);
+                    params.type = j.value("Type", params.type);
+                    params.stp = j.value("Stp", params.stp);
+                    params.stopPrice = optionalField(j, "StopPrice", params.stopPrice);
+                    params.peak = optionalField(j, "Peak", params.peak);
+                    params.expire = optionalField(j, "Expire", params.expire);
+                    params.postOnly = j.value("PostOnly", params.postOnly);
+                    params.minQty = optionalField(j, "MinQty", params.minQty);
+                    reply = GetCore().AddDeal(j["UserId"], j["Message"], params);
+                }
+                else if (reqType == Requests::Cancel)
+                {
+                    reply = GetCore().CancelDeal(j["UserId"], j["Message"]);
+                }
+                else if (reqType == Requests::Amend)
+                {
+                    reply = GetCore().AmendDeal(j["UserId"], j["Message"]);
+                }
+                else if (reqType == Requests::Deposit)
+                {
+                    reply = GetCore().Deposit(j["UserId"], j["Message"], j.value("Symbol", DefaultSymbol));
+                }
+                else if (reqType == Requests::CancelOnDisconnect)
+                {
+                    // При обрыве соединения заявки этого пользователя будут сняты.
+                    std::string userId = j["UserId"];
+                    cancelOnDisconnect_.erase(std::remove(cancelOnDisconnect_.begin(), cancelOnDisconnect_.end(), userId), cancelOnDisconnect_.end());
+                    if (j["Message"] == "on")
+                        cancelOnDisconnect_.push_back(userId);
+                    reply = "Cancel on disconnect " + std::string(j["Message"] == "on" ? "on" : "off") + "\n";
+                }
+                else if (reqType == Requests::Status)
+                {
+                    reply = GetCore().GetStatus(j["UserId"], j.value("Symbol", DefaultSymbol)) + "\n";
+                }
+                else if (reqType == Requests::Auction)
+                {
+                    reply = GetCore().Auction(j["Message"], j.value("Symbol", DefaultSymbol));
+                }
+                else if (reqType == Requests::Policy)
+                {
+                    reply = GetCore().SetPolicy(j["Message"], j.value("Symbol", DefaultSymbol));
+                }
+                else if (reqType == Requests::PriceBands)
+                {
+                    reply = GetCore().SetPriceGuard(j["Message"], j.value("Symbol", DefaultSymbol));
+                }
+                else if (reqType == Requests::Executions)
+                {
+                    reply = GetCore().GetExecutions(j["UserId"], j["Message"]);
+                }
+                else if (reqType == Requests::OrderPool)
+                {
+                    reply = "Orders resting " + std::to_string(GetCore().PoolOccupancy())
+                        + ", high water mark " + std::to_string(GetCore().PoolHighWaterMark()) + "\n";
+                }
+                else if (reqType == Requests::EndOfSession)
+                {
+                    GetCore().EndOfSession();
+                    reply = "Session closed\n";
+                }
+                else if (reqType == Requests::Free)
+                {
+                    GetCore().Free();
+                    reply = "bibip\n";
+                }
+            } catch (nlohmann::json::exception& e) {
+                reply = "Incorrect input\n";
             }
 
             boost::asio::async_write(socket_,
@@ -350,6 +2094,7 @@ public:
         }
         else
         {
+            CancelOnDisconnect();
             delete this;
         }
     }
@@ -365,12 +2110,21 @@ public:
         }
         else
         {
+            CancelOnDisconnect();
             delete this;
         }
     }
 
 private:
+    // Снимает заявки пользователей, включивших снятие при разрыве соединения.
+    void CancelOnDisconnect()
+    {
+        for (const std::string& userId : cancelOnDisconnect_)
+            GetCore().CancelUserDeals(userId);
+    }
+
     tcp::socket socket_;
+    std::vector<std::string> cancelOnDisconnect_;
     enum { max_length = 1024 };
     char data_[max_length];
 };
@@ -5,6 +5,7 @@
 #include <chrono>
 #include "json.hpp"
 #include "Common.hpp"
+#include "SeqLock.hpp"
 
 using boost::asio::ip::tcp;
 
@@ -32,6 +33,18 @@ protected:
         std::string response_str(std::istreambuf_iterator<char>(is), {});
         return response_str;
     }
+
+    // Зачисляет первым aUsers пользователям по 1000 USD и 100000 денег:
+    // заявки принимаются только в пределах свободных средств.
+    void fundUsers(int aUsers) {
+        nlohmann::json request;
+        request["ReqType"] = Requests::Deposit;
+        request["Message"] = "1000:100000";
+        for (int user = 0; user < aUsers; ++user) {
+            request["UserId"] = std::to_string(user);
+            EXPECT_EQ(sendRequest(request), "Deposit accepted\n");
+        }
+    }
 };
 
 
@@ -55,6 +68,7 @@ TEST_F(TradingServerTest, TestTradingScenario) {
     request["Message"] = "User3";
     std::string response3 = sendRequest(request);
     EXPECT_EQ(response3, "2");
+    fundUsers(3);
 
     // Выставление заявок на покупку и продажу
     request["ReqType"] = Requests::Trading;
@@ -62,12 +76,12 @@ TEST_F(TradingServerTest, TestTradingScenario) {
     request["Message"] = "20:60:buy";
     connectToServer();
     std::string response4 = sendRequest(request);
-    EXPECT_EQ(response4, "Your application is being processed\n");
+    EXPECT_EQ(response4, "Your application is being processed, order id 0\n");
 
     request["UserId"] = "1";
     request["Message"] = "30:61:buy";
     std::string response5 = sendRequest(request);
-    EXPECT_EQ(response5, "Your application is being processed\n");
+    EXPECT_EQ(response5, "Your application is being processed, order id 1\n");
 
     request["UserId"] = "2";
     request["Message"] = "30:60:sell";
@@ -78,15 +92,15 @@ TEST_F(TradingServerTest, TestTradingScenario) {
     request["ReqType"] = Requests::Status;
     request["UserId"] = "0";
     std::string status1 = sendRequest(request);
-    EXPECT_EQ(status1, "USD 0.000000, Money 0.000000\n");
+    EXPECT_EQ(status1, "USD 1000.000000, Money 100000.000000\n");
 
     request["UserId"] = "1";
     std::string status2 = sendRequest(request);
-    EXPECT_EQ(status2, "USD 30.000000, Money -1830.000000\n");
+    EXPECT_EQ(status2, "USD 1030.000000, Money 98170.000000\n");
 
     request["UserId"] = "2";
     std::string status3 = sendRequest(request);
-    EXPECT_EQ(status3, "USD -30.000000, Money 1830.000000\n");
+    EXPECT_EQ(status3, "USD 970.000000, Money 101830.000000\n");
 }
 
 TEST_F(TradingServerTest, RegisterUserAndPlaceOrders) {
@@ -108,18 +122,19 @@ TEST_F(TradingServerTest, RegisterUserAndPlaceOrders) {
     request["Message"] = "User3";
     std::string response3 = sendRequest(request);
     EXPECT_EQ(response3, "2");
+    fundUsers(3);
 
     // Выставление заявок на покупку и продажу
     request["ReqType"] = Requests::Trading;
     request["UserId"] = "0";
     request["Message"] = "10:62:buy";
     std::string response4 = sendRequest(request);
-    EXPECT_EQ(response4, "Your application is being processed\n");
+    EXPECT_EQ(response4, "Your application is being processed, order id 0\n");
 
     request["UserId"] = "1";
     request["Message"] = "20:63:buy";
     std::string response5 = sendRequest(request);
-    EXPECT_EQ(response5, "Your application is being processed\n");
+    EXPECT_EQ(response5, "Your application is being processed, order id 1\n");
 
     request["UserId"] = "2";
     request["Message"] = "30:61:sell";
@@ -130,15 +145,15 @@ TEST_F(TradingServerTest, RegisterUserAndPlaceOrders) {
     request["ReqType"] = Requests::Status;
     request["UserId"] = "0";
     std::string status1 = sendRequest(request);
-    EXPECT_EQ(status1, "USD 10.000000, Money -620.000000\n");
+    EXPECT_EQ(status1, "USD 1010.000000, Money 99380.000000\n");
 
     request["UserId"] = "1";
     std::string status2 = sendRequest(request);
-    EXPECT_EQ(status2, "USD 20.000000, Money -1260.000000\n");
+    EXPECT_EQ(status2, "USD 1020.000000, Money 98740.000000\n");
 
     request["UserId"] = "2";
     std::string status3 = sendRequest(request);
-    EXPECT_EQ(status3, "USD -30.000000, Money 1880.000000\n");
+    EXPECT_EQ(status3, "USD 970.000000, Money 101880.000000\n");
 }
 
 
@@ -178,6 +193,7 @@ TEST_F(TradingServerTest, MixedOperationsPartialMatchAndNoMatch) {
     request["Message"] = "User7";
     std::string response7 = sendRequest(request);
     EXPECT_EQ(response7, "6");
+    fundUsers(7);
 
     // Выставление заявок на покупку и продажу
     request["ReqType"] = Requests::Trading;
@@ -185,12 +201,12 @@ TEST_F(TradingServerTest, MixedOperationsPartialMatchAndNoMatch) {
     request["UserId"] = "0";
     request["Message"] = "50:100:buy";
     std::string response8 = sendRequest(request);
-    EXPECT_EQ(response8, "Your application is being processed\n");
+    EXPECT_EQ(response8, "Your application is being processed, order id 0\n");
 
     request["UserId"] = "1";
     request["Message"] = "40:110:sell";
     std::string response9 = sendRequest(request);
-    EXPECT_EQ(response9, "Your application is being processed\n");
+    EXPECT_EQ(response9, "Your application is being processed, order id 1\n");
 
     request["UserId"] = "2";
     request["Message"] = "30:90:sell";
@@ -200,53 +216,53 @@ TEST_F(TradingServerTest, MixedOperationsPartialMatchAndNoMatch) {
     request["UserId"] = "3";
     request["Message"] = "20:95:buy";
     std::string response11 = sendRequest(request);
-    EXPECT_EQ(response11, "Your application is being processed\n");
+    EXPECT_EQ(response11, "Your application is being processed, order id 2\n");
 
     request["UserId"] = "4";
     request["Message"] = "60:100:sell";
     std::string response12 = sendRequest(request);
-    EXPECT_EQ(response12, "Your application is being processed\n");
+    EXPECT_EQ(response12, "Your application is being processed, order id 4294967296\n");
 
     request["UserId"] = "5";
     request["Message"] = "50:105:sell";
     std::string response13 = sendRequest(request);
-    EXPECT_EQ(response13, "Your application is being processed\n");
+    EXPECT_EQ(response13, "Your application is being processed, order id 3\n");
 
     request["UserId"] = "6";
     request["Message"] = "10:120:buy";
     std::string response14 = sendRequest(request);
-    EXPECT_EQ(response13, "Your application is being processed\n");
+    EXPECT_EQ(response13, "Your application is being processed, order id 3\n");
     
     // Проверка статуса
     request["ReqType"] = Requests::Status;
 
     request["UserId"] = "0";	
     std::string status1 = sendRequest(request);
-    EXPECT_EQ(status1, "USD 50.000000, Money -5000.000000\n");
+    EXPECT_EQ(status1, "USD 1050.000000, Money 95000.000000\n");
 
     request["UserId"] = "1";
     std::string status2 = sendRequest(request);
-    EXPECT_EQ(status2, "USD 0.000000, Money 0.000000\n");
+    EXPECT_EQ(status2, "USD 1000.000000, Money 100000.000000\n");
 
     request["UserId"] = "2";
     std::string status3 = sendRequest(request);
-    EXPECT_EQ(status3, "USD -30.000000, Money 3000.000000\n");
+    EXPECT_EQ(status3, "USD 970.000000, Money 103000.000000\n");
 
     request["UserId"] = "3";
     std::string status4 = sendRequest(request);
-    EXPECT_EQ(status4, "USD 0.000000, Money 0.000000\n");
+    EXPECT_EQ(status4, "USD 1000.000000, Money 100000.000000\n");
 
     request["UserId"] = "4";
     std::string status5 = sendRequest(request);
-    EXPECT_EQ(status5, "USD -30.000000, Money 3000.000000\n");
+    EXPECT_EQ(status5, "USD 970.000000, Money 103000.000000\n");
 
     request["UserId"] = "5";
     std::string status6 = sendRequest(request);
-    EXPECT_EQ(status6, "USD 0.000000, Money 0.000000\n");
+    EXPECT_EQ(status6, "USD 1000.000000, Money 100000.000000\n");
 
     request["UserId"] = "6";
     std::string status7 = sendRequest(request);
-    EXPECT_EQ(status7, "USD 10.000000, Money -1000.000000\n");
+    EXPECT_EQ(status7, "USD 1010.000000, Money 99000.000000\n");
 }
 
 TEST_F(TradingServerTest, SameOperationPrice) {
@@ -285,6 +301,7 @@ TEST_F(TradingServerTest, SameOperationPrice) {
     request["Message"] = "User7";
     std::string response7 = sendRequest(request);
     EXPECT_EQ(response7, "6");
+    fundUsers(7);
 
     // Выставление заявок на покупку и продажу
     request["ReqType"] = Requests::Trading;
@@ -292,7 +309,7 @@ TEST_F(TradingServerTest, SameOperationPrice) {
     request["UserId"] = "0";
     request["Message"] = "70:100:buy";
     std::string response8 = sendRequest(request);
-    EXPECT_EQ(response8, "Your application is being processed\n");
+    EXPECT_EQ(response8, "Your application is being processed, order id 0\n");
 
     request["UserId"] = "1";
     request["Message"] = "30:100:sell";
@@ -307,53 +324,53 @@ TEST_F(TradingServerTest, SameOperationPrice) {
     request["UserId"] = "3";
     request["Message"] = "10:100:buy";
     std::string response11 = sendRequest(request);
-    EXPECT_EQ(response11, "Your application is being processed\n");
+    EXPECT_EQ(response11, "Your application is being processed, order id 4294967296\n");
 
     request["UserId"] = "4";
     request["Message"] = "20:100:sell";
     std::string response12 = sendRequest(request);
-    EXPECT_EQ(response12, "Your application is being processed\n");
+    EXPECT_EQ(response12, "Your application is being processed, order id 8589934592\n");
 
     request["UserId"] = "5";
     request["Message"] = "40:100:sell";
     std::string response13 = sendRequest(request);
-    EXPECT_EQ(response13, "Your application is being processed\n");
+    EXPECT_EQ(response13, "Your application is being processed, order id 1\n");
 
     request["UserId"] = "6";
     request["Message"] = "40:100:buy";
     std::string response14 = sendRequest(request);
-    EXPECT_EQ(response13, "Your application is being processed\n");
+    EXPECT_EQ(response13, "Your application is being processed, order id 1\n");
     
     // Проверка статуса
     request["ReqType"] = Requests::Status;
 
     request["UserId"] = "0";
     std::string status1 = sendRequest(request);
-    EXPECT_EQ(status1, "USD 70.000000, Money -7000.000000\n");
+    EXPECT_EQ(status1, "USD 1070.000000, Money 93000.000000\n");
 
     request["UserId"] = "1";
     std::string status2 = sendRequest(request);
-    EXPECT_EQ(status2, "USD -30.000000, Money 3000.000000\n");
+    EXPECT_EQ(status2, "USD 970.000000, Money 103000.000000\n");
 
     request["UserId"] = "2";
     std::string status3 = sendRequest(request);
-    EXPECT_EQ(status3, "USD -40.000000, Money 4000.000000\n");
+    EXPECT_EQ(status3, "USD 960.000000, Money 104000.000000\n");
 
     request["UserId"] = "3";
     std::string status4 = sendRequest(request);
-    EXPECT_EQ(status4, "USD 10.000000, Money -1000.000000\n");
+    EXPECT_EQ(status4, "USD 1010.000000, Money 99000.000000\n");
 
     request["UserId"] = "4";
     std::string status5 = sendRequest(request);
-    EXPECT_EQ(status5, "USD -20.000000, Money 2000.000000\n");
+    EXPECT_EQ(status5, "USD 980.000000, Money 102000.000000\n");
 
     request["UserId"] = "5";
     std::string status6 = sendRequest(request);
-    EXPECT_EQ(status6, "USD -30.000000, Money 3000.000000\n");
+    EXPECT_EQ(status6, "USD 970.000000, Money 103000.000000\n");
 
     request["UserId"] = "6";
     std::string status7 = sendRequest(request);
-    EXPECT_EQ(status7, "USD 40.000000, Money -4000.000000\n");
+    EXPECT_EQ(status7, "USD 1040.000000, Money 96000.000000\n");
 }
 
 TEST_F(TradingServerTest, DifferentPrices1) {
@@ -392,6 +409,7 @@ TEST_F(TradingServerTest, DifferentPrices1) {
     request["Message"] = "User7";
     std::string response7 = sendRequest(request);
     EXPECT_EQ(response7, "6");
+    fundUsers(7);
 
     // Выставление заявок на покупку и продажу
     request["ReqType"] = Requests::Trading;
@@ -399,12 +417,12 @@ TEST_F(TradingServerTest, DifferentPrices1) {
     request["UserId"] = "0";
     request["Message"] = "25:60:buy";
     std::string response8 = sendRequest(request);
-    EXPECT_EQ(response8, "Your application is being processed\n");
+    EXPECT_EQ(response8, "Your application is being processed, order id 0\n");
 
     request["UserId"] = "1";
     request["Message"] = "35:70:buy";
     std::string response9 = sendRequest(request);
-    EXPECT_EQ(response9, "Your application is being processed\n");
+    EXPECT_EQ(response9, "Your application is being processed, order id 1\n");
 
     request["UserId"] = "2";
     request["Message"] = "30:60:sell";
@@ -414,7 +432,7 @@ TEST_F(TradingServerTest, DifferentPrices1) {
     request["UserId"] = "3";
     request["Message"] = "15:80:buy";
     std::string response11 = sendRequest(request);
-    EXPECT_EQ(response11, "Your application is being processed\n");
+    EXPECT_EQ(response11, "Your application is being processed, order id 2\n");
 
     request["UserId"] = "4";
     request["Message"] = "20:70:sell";
@@ -424,43 +442,43 @@ TEST_F(TradingServerTest, DifferentPrices1) {
     request["UserId"] = "5";
     request["Message"] = "10:80:sell";
     std::string response13 = sendRequest(request);
-    EXPECT_EQ(response13, "Your application is being processed\n");
+    EXPECT_EQ(response13, "Your application is being processed, order id 4294967297\n");
 
     request["UserId"] = "6";
     request["Message"] = "30:60:sell";
     std::string response14 = sendRequest(request);
-    EXPECT_EQ(response13, "Your application is being processed\n");
+    EXPECT_EQ(response13, "Your application is being processed, order id 4294967297\n");
     
     // Проверка статуса
     request["ReqType"] = Requests::Status;
 
     request["UserId"] = "0";
     std::string status1 = sendRequest(request);
-    EXPECT_EQ(status1, "USD 25.000000, Money -1500.000000\n");
+    EXPECT_EQ(status1, "USD 1025.000000, Money 98500.000000\n");
 
     request["UserId"] = "1";
     std::string status2 = sendRequest(request);
-    EXPECT_EQ(status2, "USD 35.000000, Money -2450.000000\n");
+    EXPECT_EQ(status2, "USD 1035.000000, Money 97550.000000\n");
 
     request["UserId"] = "2";
     std::string status3 = sendRequest(request);
-    EXPECT_EQ(status3, "USD -30.000000, Money 2100.000000\n");
+    EXPECT_EQ(status3, "USD 970.000000, Money 102100.000000\n");
 
     request["UserId"] = "3";
     std::string status4 = sendRequest(request);
-    EXPECT_EQ(status4, "USD 15.000000, Money -1200.000000\n");
+    EXPECT_EQ(status4, "USD 1015.000000, Money 98800.000000\n");
 
     request["UserId"] = "4";
     std::string status5 = sendRequest(request);
-    EXPECT_EQ(status5, "USD -20.000000, Money 1550.000000\n");
+    EXPECT_EQ(status5, "USD 980.000000, Money 101550.000000\n");
 
     request["UserId"] = "5";
     std::string status6 = sendRequest(request);
-    EXPECT_EQ(status6, "USD 0.000000, Money 0.000000\n");
+    EXPECT_EQ(status6, "USD 1000.000000, Money 100000.000000\n");
 
     request["UserId"] = "6";
     std::string status7 = sendRequest(request);
-    EXPECT_EQ(status7, "USD -25.000000, Money 1500.000000\n");
+    EXPECT_EQ(status7, "USD 975.000000, Money 101500.000000\n");
 }
 
 
@@ -500,6 +518,7 @@ TEST_F(TradingServerTest, DifferentPrices2) {
     request["Message"] = "User7";
     std::string response7 = sendRequest(request);
     EXPECT_EQ(response7, "6");
+    fundUsers(7);
 
     // Выставление заявок на покупку и продажу
     request["ReqType"] = Requests::Trading;
@@ -507,7 +526,7 @@ TEST_F(TradingServerTest, DifferentPrices2) {
     request["UserId"] = "0";
     request["Message"] = "100:90:buy";
     std::string response8 = sendRequest(request);
-    EXPECT_EQ(response8, "Your application is being processed\n");
+    EXPECT_EQ(response8, "Your application is being processed, order id 0\n");
 
     request["UserId"] = "1";
     request["Message"] = "40:80:sell";
@@ -522,53 +541,53 @@ TEST_F(TradingServerTest, DifferentPrices2) {
     request["UserId"] = "3";
     request["Message"] = "30:95:buy";
     std::string response11 = sendRequest(request);
-    EXPECT_EQ(response11, "Your application is being processed\n");
+    EXPECT_EQ(response11, "Your application is being processed, order id 1\n");
 
     request["UserId"] = "4";
     request["Message"] = "20:80:buy";
     std::string response12 = sendRequest(request);
-    EXPECT_EQ(response12, "Your application is being processed\n");
+    EXPECT_EQ(response12, "Your application is being processed, order id 2\n");
 
     request["UserId"] = "5";
     request["Message"] = "60:100:sell";
     std::string response13 = sendRequest(request);
-    EXPECT_EQ(response13, "Your application is being processed\n");
+    EXPECT_EQ(response13, "Your application is being processed, order id 3\n");
 
     request["UserId"] = "6";
     request["Message"] = "50:85:buy";
     std::string response14 = sendRequest(request);
-    EXPECT_EQ(response13, "Your application is being processed\n");
+    EXPECT_EQ(response13, "Your application is being processed, order id 3\n");
     
     // Проверка статуса
     request["ReqType"] = Requests::Status;
 
     request["UserId"] = "0";
     std::string status1 = sendRequest(request);
-    EXPECT_EQ(status1, "USD 90.000000, Money -8100.000000\n");
+    EXPECT_EQ(status1, "USD 1090.000000, Money 91900.000000\n");
 
     request["UserId"] = "1";
     std::string status2 = sendRequest(request);
-    EXPECT_EQ(status2, "USD -40.000000, Money 3600.000000\n");
+    EXPECT_EQ(status2, "USD 960.000000, Money 103600.000000\n");
 
     request["UserId"] = "2";
     std::string status3 = sendRequest(request);
-    EXPECT_EQ(status3, "USD -50.000000, Money 4500.000000\n");
+    EXPECT_EQ(status3, "USD 950.000000, Money 104500.000000\n");
 
     request["UserId"] = "3";
     std::string status4 = sendRequest(request);
-    EXPECT_EQ(status4, "USD 0.000000, Money 0.000000\n");
+    EXPECT_EQ(status4, "USD 1000.000000, Money 100000.000000\n");
 
     request["UserId"] = "4";
     std::string status5 = sendRequest(request);
-    EXPECT_EQ(status5, "USD 0.000000, Money 0.000000\n");
+    EXPECT_EQ(status5, "USD 1000.000000, Money 100000.000000\n");
 
     request["UserId"] = "5";
     std::string status6 = sendRequest(request);
-    EXPECT_EQ(status6, "USD 0.000000, Money 0.000000\n");
+    EXPECT_EQ(status6, "USD 1000.000000, Money 100000.000000\n");
 
     request["UserId"] = "6";
     std::string status7 = sendRequest(request);
-    EXPECT_EQ(status7, "USD 0.000000, Money 0.000000\n");
+    EXPECT_EQ(status7, "USD 1000.000000, Money 100000.000000\n");
 }
 
 TEST_F(TradingServerTest, InvalidTradingRequests) {
@@ -612,6 +631,1748 @@ TEST_F(TradingServerTest, InvalidTradingRequests) {
     EXPECT_EQ(response6, "Incorrect input\n");
 }
 
+TEST_F(TradingServerTest, FractionalPricesAreExact) {
+    nlohmann::json request;
+    request["ReqType"] = Requests::Free;
+    request["Message"] = "bibip";
+    connectToServer();
+    sendRequest(request);
+
+    // Регистрация пользователей
+    request["ReqType"] = Requests::Registration;
+    request["Message"] = "User1";
+    std::string response1 = sendRequest(request);
+    EXPECT_EQ(response1, "0");
+
+    request["Message"] = "User2";
+    std::string response2 = sendRequest(request);
+    EXPECT_EQ(response2, "1");
+    fundUsers(2);
+
+    // Дробные количества и цены считаются без потери точности
+    request["ReqType"] = Requests::Trading;
+    request["UserId"] = "0";
+    request["Message"] = "0.1:60.1:buy";
+    std::string response3 = sendRequest(request);
+    EXPECT_EQ(response3, "Your application is being processed, order id 0\n");
+
+    request["Message"] = "0.2:60.1:buy";
+    std::string response4 = sendRequest(request);
+    EXPECT_EQ(response4, "Your application is being processed, order id 1\n");
+
+    request["UserId"] = "1";
+    request["Message"] = "0.3:60.1:sell";
+    std::string response5 = sendRequest(request);
+    EXPECT_EQ(response5, "Your application is being processed\n");
+
+    // Точность выше масштаба цены отклоняется
+    request["Message"] = "1:60.125:sell";
+    std::string response6 = sendRequest(request);
+    EXPECT_EQ(response6, "Incorrect input\n");
+
+    // Проверка статуса
+    request["ReqType"] = Requests::Status;
+    request["UserId"] = "0";
+    std::string status1 = sendRequest(request);
+    EXPECT_EQ(status1, "USD 1000.300000, Money 99981.970000\n");
+
+    request["UserId"] = "1";
+    std::string status2 = sendRequest(request);
+    EXPECT_EQ(status2, "USD 999.700000, Money 100018.030000\n");
+}
+
+TEST_F(TradingServerTest, CancelAndAmendOrders) {
+    nlohmann::json request;
+    request["ReqType"] = Requests::Free;
+    request["Message"] = "bibip";
+    connectToServer();
+    sendRequest(request);
+
+    // Регистрация пользователей
+    request["ReqType"] = Requests::Registration;
+    request["Message"] = "User1";
+    std::string response1 = sendRequest(request);
+    EXPECT_EQ(response1, "0");
+
+    request["Message"] = "User2";
+    std::string response2 = sendRequest(request);
+    EXPECT_EQ(response2, "1");
+    fundUsers(2);
+
+    // Две заявки на покупку по одной цене
+    request["ReqType"] = Requests::Trading;
+    request["UserId"] = "0";
+    request["Message"] = "10:100:buy";
+    std::string response3 = sendRequest(request);
+    EXPECT_EQ(response3, "Your application is being processed, order id 0\n");
+
+    request["Message"] = "10:100:buy";
+    std::string response4 = sendRequest(request);
+    EXPECT_EQ(response4, "Your application is being processed, order id 1\n");
+
+    // Чужую заявку снять нельзя
+    request["ReqType"] = Requests::Cancel;
+    request["UserId"] = "1";
+    request["Message"] = "0";
+    std::string response5 = sendRequest(request);
+    EXPECT_EQ(response5, "Unknown order\n");
+
+    // Уменьшение объема сохраняет место в очереди
+    request["ReqType"] = Requests::Amend;
+    request["UserId"] = "0";
+    request["Message"] = "0:5:100";
+    std::string response6 = sendRequest(request);
+    EXPECT_EQ(response6, "Order amended\n");
+
+    request["ReqType"] = Requests::Cancel;
+    request["Message"] = "1";
+    std::string response7 = sendRequest(request);
+    EXPECT_EQ(response7, "Order cancelled\n");
+
+    std::string response8 = sendRequest(request);
+    EXPECT_EQ(response8, "Unknown order\n");
+
+    // Продажа исполняет оставшиеся 5 и встает в стакан остатком
+    request["ReqType"] = Requests::Trading;
+    request["UserId"] = "1";
+    request["Message"] = "8:99:sell";
+    std::string response9 = sendRequest(request);
+    EXPECT_EQ(response9, "Your application is being processed, order id 4294967296\n");
+
+    request["UserId"] = "0";
+    request["Message"] = "2:98:buy";
+    std::string response10 = sendRequest(request);
+    EXPECT_EQ(response10, "Your application is being processed, order id 4294967297\n");
+
+    // Смена цены ставит заявку заново и сводит ее со стаканом
+    request["ReqType"] = Requests::Amend;
+    request["Message"] = "4294967297:2:99";
+    std::string response11 = sendRequest(request);
+    EXPECT_EQ(response11, "Order amended\n");
+
+    request["Message"] = "4294967297:1:99";
+    std::string response12 = sendRequest(request);
+    EXPECT_EQ(response12, "Unknown order\n");
+
+    // Проверка статуса
+    request["ReqType"] = Requests::Status;
+    request["UserId"] = "0";
+    std::string status1 = sendRequest(request);
+    EXPECT_EQ(status1, "USD 1007.000000, Money 99302.000000\n");
+
+    request["UserId"] = "1";
+    std::string status2 = sendRequest(request);
+    EXPECT_EQ(status2, "USD 993.000000, Money 100698.000000\n");
+}
+
+TEST_F(TradingServerTest, IndependentSymbolBooks) {
+    nlohmann::json request;
+    request["ReqType"] = Requests::Free;
+    request["Message"] = "bibip";
+    connectToServer();
+    sendRequest(request);
+
+    // Регистрация пользователей
+    request["ReqType"] = Requests::Registration;
+    request["Message"] = "User1";
+    std::string response1 = sendRequest(request);
+    EXPECT_EQ(response1, "0");
+
+    request["Message"] = "User2";
+    std::string response2 = sendRequest(request);
+    EXPECT_EQ(response2, "1");
+    fundUsers(2);
+
+    // Инструмент EUR зачисляется отдельно
+    request["ReqType"] = Requests::Deposit;
+    request["UserId"] = "1";
+    request["Symbol"] = "EUR";
+    request["Message"] = "10:0";
+    std::string deposit = sendRequest(request);
+    EXPECT_EQ(deposit, "Deposit accepted\n");
+
+    // Заявки по разным инструментам не сводятся друг с другом
+    request["ReqType"] = Requests::Trading;
+    request["UserId"] = "0";
+    request["Symbol"] = "EUR";
+    request["Message"] = "10:90:buy";
+    std::string response3 = sendRequest(request);
+    EXPECT_EQ(response3, "Your application is being processed, order id 0\n");
+
+    request["UserId"] = "1";
+    request["Symbol"] = "USD";
+    request["Message"] = "10:80:sell";
+    std::string response4 = sendRequest(request);
+    EXPECT_EQ(response4, "Your application is being processed, order id 1\n");
+
+    request["Symbol"] = "EUR";
+    request["Message"] = "4:85:sell";
+    std::string response5 = sendRequest(request);
+    EXPECT_EQ(response5, "Your application is being processed\n");
+
+    // Проверка статуса по каждому инструменту
+    request["ReqType"] = Requests::Status;
+    request["UserId"] = "0";
+    std::string status1 = sendRequest(request);
+    EXPECT_EQ(status1, "EUR 4.000000, Money 99640.000000\n");
+
+    request["Symbol"] = "USD";
+    std::string status2 = sendRequest(request);
+    EXPECT_EQ(status2, "USD 1000.000000, Money 99640.000000\n");
+
+    request["UserId"] = "1";
+    request["Symbol"] = "EUR";
+    std::string status3 = sendRequest(request);
+    EXPECT_EQ(status3, "EUR 6.000000, Money 100360.000000\n");
+
+    request["Symbol"] = "GBP";
+    std::string status4 = sendRequest(request);
+    EXPECT_EQ(status4, "Error! Unknown symbol\n");
+
+    // Заявка, которая не встала, не заводит стакан нового инструмента
+    request["ReqType"] = Requests::Trading;
+    request["Type"] = "ioc";
+    request["Message"] = "1:100:buy";
+    std::string response6 = sendRequest(request);
+    EXPECT_EQ(response6, "Order cancelled, remaining 1.000000\n");
+
+    request["ReqType"] = Requests::Status;
+    std::string status5 = sendRequest(request);
+    EXPECT_EQ(status5, "Error! Unknown symbol\n");
+
+    request["ReqType"] = Requests::Policy;
+    request["Message"] = "pro-rata";
+    std::string response7 = sendRequest(request);
+    EXPECT_EQ(response7, "Error! Unknown symbol\n");
+
+    // Нулевое зачисление отклоняется, зачисление одних денег стакан не заводит
+    request["ReqType"] = Requests::Deposit;
+    request["Message"] = "0:0";
+    std::string response8 = sendRequest(request);
+    EXPECT_EQ(response8, "Incorrect input\n");
+
+    request["Message"] = "0:10";
+    std::string response9 = sendRequest(request);
+    EXPECT_EQ(response9, "Deposit accepted\n");
+
+    request["ReqType"] = Requests::Status;
+    std::string status6 = sendRequest(request);
+    EXPECT_EQ(status6, "Error! Unknown symbol\n");
+
+    request["Symbol"] = "USD";
+    std::string status7 = sendRequest(request);
+    EXPECT_EQ(status7, "USD 1000.000000, Money 100370.000000\n");
+}
+
+TEST_F(TradingServerTest, MarketIocAndFokNeverRest) {
+    nlohmann::json request;
+    request["ReqType"] = Requests::Free;
+    request["Message"] = "bibip";
+    connectToServer();
+    sendRequest(request);
+
+    // Регистрация пользователей
+    request["ReqType"] = Requests::Registration;
+    request["Message"] = "User1";
+    std::string response1 = sendRequest(request);
+    EXPECT_EQ(response1, "0");
+
+    request["Message"] = "User2";
+    std::string response2 = sendRequest(request);
+    EXPECT_EQ(response2, "1");
+    fundUsers(2);
+
+    request["ReqType"] = Requests::Trading;
+    request["UserId"] = "0";
+    request["Message"] = "10:100:sell";
+    std::string response3 = sendRequest(request);
+    EXPECT_EQ(response3, "Your application is being processed, order id 0\n");
+
+    // FOK не исполняется, если объема не хватает
+    request["UserId"] = "1";
+    request["Type"] = "fok";
+    request["Message"] = "15:100:buy";
+    std::string response4 = sendRequest(request);
+    EXPECT_EQ(response4, "Order killed\n");
+
+    request["Type"] = "ioc";
+    request["Message"] = "4:100:buy";
+    std::string response5 = sendRequest(request);
+    EXPECT_EQ(response5, "Your application is being processed\n");
+
+    // Неисполненный IOC не встает в стакан
+    request["Message"] = "10:99:buy";
+    std::string response6 = sendRequest(request);
+    EXPECT_EQ(response6, "Order cancelled, remaining 10.000000\n");
+
+    request["UserId"] = "0";
+    request["Type"] = "limit";
+    request["Message"] = "1:99:sell";
+    std::string response7 = sendRequest(request);
+    EXPECT_EQ(response7, "Your application is being processed, order id 1\n");
+
+    // Рыночная заявка указывается без цены
+    request["UserId"] = "1";
+    request["Type"] = "market";
+    request["Message"] = "3:100:buy";
+    std::string response8 = sendRequest(request);
+    EXPECT_EQ(response8, "Incorrect input\n");
+
+    request["Message"] = "3::buy";
+    std::string response9 = sendRequest(request);
+    EXPECT_EQ(response9, "Your application is being processed\n");
+
+    request["Type"] = "fok";
+    request["Message"] = "3:100:buy";
+    std::string response10 = sendRequest(request);
+    EXPECT_EQ(response10, "Your application is being processed\n");
+
+    request["Type"] = "gtc";
+    std::string response11 = sendRequest(request);
+    EXPECT_EQ(response11, "Incorrect input\n");
+
+    // Частично исполненный IOC сообщает о снятом остатке
+    request["Type"] = "ioc";
+    request["Message"] = "5:100:buy";
+    std::string response12 = sendRequest(request);
+    EXPECT_EQ(response12, "Order cancelled, remaining 4.000000\n");
+
+    // Проверка статуса
+    request["ReqType"] = Requests::Status;
+    request["UserId"] = "0";
+    std::string status1 = sendRequest(request);
+    EXPECT_EQ(status1, "USD 989.000000, Money 101099.000000\n");
+
+    request["UserId"] = "1";
+    std::string status2 = sendRequest(request);
+    EXPECT_EQ(status2, "USD 1011.000000, Money 98901.000000\n");
+}
+
+TEST_F(TradingServerTest, DepositedAccountsTradeWithinFunds) {
+    nlohmann::json request;
+    request["ReqType"] = Requests::Free;
+    request["Message"] = "bibip";
+    connectToServer();
+    sendRequest(request);
+
+    // Регистрация пользователей
+    request["ReqType"] = Requests::Registration;
+    request["Message"] = "User1";
+    std::string response1 = sendRequest(request);
+    EXPECT_EQ(response1, "0");
+
+    request["Message"] = "User2";
+    std::string response2 = sendRequest(request);
+    EXPECT_EQ(response2, "1");
+
+    // Зачисление средств
+    request["ReqType"] = Requests::Deposit;
+    request["UserId"] = "0";
+    request["Message"] = "0:1000";
+    std::string response3 = sendRequest(request);
+    EXPECT_EQ(response3, "Deposit accepted\n");
+
+    request["UserId"] = "1";
+    request["Message"] = "10:0";
+    std::string response4 = sendRequest(request);
+    EXPECT_EQ(response4, "Deposit accepted\n");
+
+    // Заявка резервирует деньги по своей цене
+    request["ReqType"] = Requests::Trading;
+    request["UserId"] = "0";
+    request["Message"] = "10:100:buy";
+    std::string response5 = sendRequest(request);
+    EXPECT_EQ(response5, "Your application is being processed, order id 0\n");
+
+    request["Message"] = "1:1:buy";
+    std::string response6 = sendRequest(request);
+    EXPECT_EQ(response6, "Insufficient funds\n");
+
+    request["UserId"] = "1";
+    request["Message"] = "11:90:sell";
+    std::string response7 = sendRequest(request);
+    EXPECT_EQ(response7, "Insufficient funds\n");
+
+    request["Message"] = "4:90:sell";
+    std::string response8 = sendRequest(request);
+    EXPECT_EQ(response8, "Your application is being processed\n");
+
+    // Снятие заявки освобождает остаток резерва
+    request["ReqType"] = Requests::Cancel;
+    request["UserId"] = "0";
+    request["Message"] = "0";
+    std::string response9 = sendRequest(request);
+    EXPECT_EQ(response9, "Order cancelled\n");
+
+    request["ReqType"] = Requests::Trading;
+    request["Message"] = "6:100:buy";
+    std::string response10 = sendRequest(request);
+    EXPECT_EQ(response10, "Your application is being processed, order id 4294967296\n");
+
+    request["ReqType"] = Requests::Amend;
+    request["Message"] = "4294967296:7:100";
+    std::string response11 = sendRequest(request);
+    EXPECT_EQ(response11, "Insufficient funds\n");
+
+    // Проверка статуса
+    request["ReqType"] = Requests::Status;
+    request["UserId"] = "0";
+    std::string status1 = sendRequest(request);
+    EXPECT_EQ(status1, "USD 4.000000, Money 600.000000\n");
+
+    request["UserId"] = "1";
+    std::string status2 = sendRequest(request);
+    EXPECT_EQ(status2, "USD 6.000000, Money 400.000000\n");
+
+    // Рыночная покупка дороже свободного остатка отклоняется
+    request["ReqType"] = Requests::Trading;
+    request["Message"] = "2:105:sell";
+    std::string response12 = sendRequest(request);
+    EXPECT_EQ(response12, "Your application is being processed, order id 1\n");
+
+    request["UserId"] = "0";
+    request["Type"] = "market";
+    request["Message"] = "1::buy";
+    std::string response13 = sendRequest(request);
+    EXPECT_EQ(response13, "Insufficient funds\n");
+
+    // Счет без зачислений ничего не может зарезервировать
+    request["ReqType"] = Requests::Registration;
+    request["Message"] = "User3";
+    std::string response14 = sendRequest(request);
+    EXPECT_EQ(response14, "2");
+
+    request["ReqType"] = Requests::Trading;
+    request["UserId"] = "2";
+    request["Type"] = "limit";
+    request["Message"] = "1:95:buy";
+    std::string response15 = sendRequest(request);
+    EXPECT_EQ(response15, "Insufficient funds\n");
+
+    request["Message"] = "1:95:sell";
+    std::string response16 = sendRequest(request);
+    EXPECT_EQ(response16, "Insufficient funds\n");
+}
+
+TEST_F(TradingServerTest, CancelOnDisconnect) {
+    nlohmann::json request;
+    request["ReqType"] = Requests::Free;
+    request["Message"] = "bibip";
+    connectToServer();
+    sendRequest(request);
+
+    // Регистрация пользователей
+    request["ReqType"] = Requests::Registration;
+    request["Message"] = "User1";
+    std::string response1 = sendRequest(request);
+    EXPECT_EQ(response1, "0");
+
+    request["Message"] = "User2";
+    std::string response2 = sendRequest(request);
+    EXPECT_EQ(response2, "1");
+    fundUsers(2);
+
+    // Заявки пользователя 0 снимаются при разрыве, пользователя 1 - остаются
+    request["ReqType"] = Requests::CancelOnDisconnect;
+    request["UserId"] = "0";
+    request["Message"] = "on";
+    std::string response3 = sendRequest(request);
+    EXPECT_EQ(response3, "Cancel on disconnect on\n");
+
+    request["ReqType"] = Requests::Trading;
+    request["Message"] = "10:100:buy";
+    std::string response4 = sendRequest(request);
+    EXPECT_EQ(response4, "Your application is being processed, order id 0\n");
+
+    request["Message"] = "5:99:buy";
+    std::string response5 = sendRequest(request);
+    EXPECT_EQ(response5, "Your application is being processed, order id 1\n");
+
+    request["UserId"] = "1";
+    request["Message"] = "5:120:sell";
+    std::string response6 = sendRequest(request);
+    EXPECT_EQ(response6, "Your application is being processed, order id 2\n");
+
+    // Переподключение закрывает прежнее соединение
+    connectToServer();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    request["Message"] = "20:90:sell";
+    std::string response7 = sendRequest(request);
+    EXPECT_EQ(response7, "Your application is being processed, order id 4294967296\n");
+
+    // Проверка статуса
+    request["ReqType"] = Requests::Status;
+    request["UserId"] = "0";
+    std::string status1 = sendRequest(request);
+    EXPECT_EQ(status1, "USD 1000.000000, Money 100000.000000\n");
+
+    request["UserId"] = "1";
+    std::string status2 = sendRequest(request);
+    EXPECT_EQ(status2, "USD 1000.000000, Money 100000.000000\n");
+}
+
+TEST_F(TradingServerTest, SelfTradePrevention) {
+    nlohmann::json request;
+    request["ReqType"] = Requests::Free;
+    request["Message"] = "bibip";
+    connectToServer();
+    sendRequest(request);
+
+    // Регистрация пользователей
+    request["ReqType"] = Requests::Registration;
+    request["Message"] = "User1";
+    std::string response1 = sendRequest(request);
+    EXPECT_EQ(response1, "0");
+
+    request["Message"] = "User2";
+    std::string response2 = sendRequest(request);
+    EXPECT_EQ(response2, "1");
+    fundUsers(2);
+
+    request["ReqType"] = Requests::Trading;
+    request["UserId"] = "0";
+    request["Message"] = "10:100:buy";
+    std::string response3 = sendRequest(request);
+    EXPECT_EQ(response3, "Your application is being processed, order id 0\n");
+
+    // Входящая заявка снимается и не встает в стакан
+    request["Stp"] = "cancel-newest";
+    request["Message"] = "4:100:sell";
+    std::string response4 = sendRequest(request);
+    EXPECT_EQ(response4, "Order cancelled, remaining 4.000000\n");
+
+    // Обе заявки уменьшаются на 4 без сделки
+    request["Stp"] = "decrement-both";
+    std::string response5 = sendRequest(request);
+    EXPECT_EQ(response5, "Your application is being processed\n");
+
+    request["Stp"] = "none";
+    request["UserId"] = "1";
+    request["Message"] = "2:100:sell";
+    std::string response6 = sendRequest(request);
+    EXPECT_EQ(response6, "Your application is being processed\n");
+
+    // Снимается стоящая заявка, входящая встает в стакан
+    request["Stp"] = "cancel-oldest";
+    request["UserId"] = "0";
+    request["Message"] = "3:100:sell";
+    std::string response7 = sendRequest(request);
+    EXPECT_EQ(response7, "Your application is being processed, order id 4294967296\n");
+
+    request["Stp"] = "none";
+    request["UserId"] = "1";
+    request["Message"] = "3:100:buy";
+    std::string response8 = sendRequest(request);
+    EXPECT_EQ(response8, "Your application is being processed\n");
+
+    request["Stp"] = "sometimes";
+    std::string response9 = sendRequest(request);
+    EXPECT_EQ(response9, "Incorrect input\n");
+
+    // Проверка статуса
+    request["ReqType"] = Requests::Status;
+    request["UserId"] = "0";
+    std::string status1 = sendRequest(request);
+    EXPECT_EQ(status1, "USD 999.000000, Money 100100.000000\n");
+
+    request["UserId"] = "1";
+    std::string status2 = sendRequest(request);
+    EXPECT_EQ(status2, "USD 1001.000000, Money 99900.000000\n");
+}
+
+
+TEST_F(TradingServerTest, FillOrKillStopsAtOwnOrder) {
+    nlohmann::json request;
+    request["ReqType"] = Requests::Free;
+    request["Message"] = "bibip";
+    connectToServer();
+    sendRequest(request);
+
+    // Регистрация пользователей
+    request["ReqType"] = Requests::Registration;
+    request["Message"] = "User1";
+    std::string response1 = sendRequest(request);
+    EXPECT_EQ(response1, "0");
+
+    request["Message"] = "User2";
+    std::string response2 = sendRequest(request);
+    EXPECT_EQ(response2, "1");
+    fundUsers(2);
+
+    // Своя заявка между чужими уровнями
+    request["ReqType"] = Requests::Trading;
+    request["UserId"] = "1";
+    request["Message"] = "5:99:sell";
+    std::string response3 = sendRequest(request);
+    EXPECT_EQ(response3, "Your application is being processed, order id 0\n");
+
+    request["UserId"] = "0";
+    request["Message"] = "10:100:sell";
+    std::string response4 = sendRequest(request);
+    EXPECT_EQ(response4, "Your application is being processed, order id 1\n");
+
+    request["UserId"] = "1";
+    request["Message"] = "10:101:sell";
+    std::string response5 = sendRequest(request);
+    EXPECT_EQ(response5, "Your application is being processed, order id 2\n");
+
+    // При "cancel-newest" сведение остановится на своей заявке, за ней
+    // объем недоступен: FOK снимается без сделок
+    request["UserId"] = "0";
+    request["Type"] = "fok";
+    request["Stp"] = "cancel-newest";
+    request["Message"] = "10:101:buy";
+    std::string response6 = sendRequest(request);
+    EXPECT_EQ(response6, "Order killed\n");
+
+    // При "cancel-oldest" своя заявка снимается, и объема хватает
+    request["Stp"] = "cancel-oldest";
+    std::string response7 = sendRequest(request);
+    EXPECT_EQ(response7, "Your application is being processed\n");
+
+    request["ReqType"] = Requests::Status;
+    std::string status1 = sendRequest(request);
+    EXPECT_EQ(status1, "USD 1010.000000, Money 99000.000000\n");
+}
+
+TEST_F(TradingServerTest, StopOrdersTriggerOnLastPrice) {
+    nlohmann::json request;
+    request["ReqType"] = Requests::Free;
+    request["Message"] = "bibip";
+    connectToServer();
+    sendRequest(request);
+
+    // Регистрация пользователей
+    request["ReqType"] = Requests::Registration;
+    request["Message"] = "User1";
+    std::string response1 = sendRequest(request);
+    EXPECT_EQ(response1, "0");
+
+    request["Message"] = "User2";
+    std::string response2 = sendRequest(request);
+    EXPECT_EQ(response2, "1");
+
+    request["Message"] = "User3";
+    std::string response3 = sendRequest(request);
+    EXPECT_EQ(response3, "2");
+    fundUsers(3);
+
+    request["ReqType"] = Requests::Trading;
+    request["UserId"] = "0";
+    request["Message"] = "10:100:sell";
+    std::string response4 = sendRequest(request);
+    EXPECT_EQ(response4, "Your application is being processed, order id 0\n");
+
+    request["Message"] = "10:102:sell";
+    std::string response5 = sendRequest(request);
+    EXPECT_EQ(response5, "Your application is being processed, order id 1\n");
+
+    // Стоп-заявки ждут срабатывания и получают OrderId
+    request["UserId"] = "1";
+    request["Type"] = "stop";
+    request["StopPrice"] = "101";
+    request["Message"] = "5::buy";
+    std::string response6 = sendRequest(request);
+    EXPECT_EQ(response6, "Your application is being processed, order id 2\n");
+
+    request["Type"] = "stop-limit";
+    request["StopPrice"] = "99";
+    request["Message"] = "3:98:sell";
+    std::string response7 = sendRequest(request);
+    EXPECT_EQ(response7, "Your application is being processed, order id 3\n");
+
+    request["Message"] = "3:98";
+    std::string response8 = sendRequest(request);
+    EXPECT_EQ(response8, "Incorrect input\n");
+
+    // Цена стопа без стоп-заявки
+    request["Type"] = "limit";
+    request["Message"] = "3:98:sell";
+    std::string response9 = sendRequest(request);
+    EXPECT_EQ(response9, "Incorrect input\n");
+
+    // Сделка по 100 не доходит до стопов
+    request.erase("StopPrice");
+    request["UserId"] = "2";
+    request["Message"] = "10:100:buy";
+    std::string response10 = sendRequest(request);
+    EXPECT_EQ(response10, "Your application is being processed\n");
+
+    // Сделка по 102 активирует стоп-покупку, она покупает 5 по 102
+    request["Message"] = "1:102:buy";
+    std::string response11 = sendRequest(request);
+    EXPECT_EQ(response11, "Your application is being processed\n");
+
+    request["ReqType"] = Requests::Cancel;
+    request["UserId"] = "1";
+    request["Message"] = "2";
+    std::string response12 = sendRequest(request);
+    EXPECT_EQ(response12, "Unknown order\n");
+
+    request["Message"] = "3";
+    std::string response13 = sendRequest(request);
+    EXPECT_EQ(response13, "Order cancelled\n");
+
+    // Проверка статуса
+    request["ReqType"] = Requests::Status;
+    request["UserId"] = "0";
+    std::string status1 = sendRequest(request);
+    EXPECT_EQ(status1, "USD 984.000000, Money 101612.000000\n");
+
+    request["UserId"] = "1";
+    std::string status2 = sendRequest(request);
+    EXPECT_EQ(status2, "USD 1005.000000, Money 99490.000000\n");
+
+    request["UserId"] = "2";
+    std::string status3 = sendRequest(request);
+    EXPECT_EQ(status3, "USD 1011.000000, Money 98898.000000\n");
+
+    // Проход по 95 и 102 заканчивается по 102, но стоп-продажу по 97 задевает
+    request["ReqType"] = Requests::Trading;
+    request["UserId"] = "1";
+    request["Type"] = "stop";
+    request["StopPrice"] = "97";
+    request["Message"] = "1::sell";
+    std::string response14 = sendRequest(request);
+    EXPECT_EQ(response14, "Your application is being processed, order id 4294967299\n");
+
+    request.erase("StopPrice");
+    request["Type"] = "limit";
+    request["UserId"] = "0";
+    request["Message"] = "1:95:sell";
+    std::string response15 = sendRequest(request);
+    EXPECT_EQ(response15, "Your application is being processed, order id 4294967298\n");
+
+    request["UserId"] = "2";
+    request["Message"] = "2:102:buy";
+    std::string response16 = sendRequest(request);
+    EXPECT_EQ(response16, "Your application is being processed\n");
+
+    request["ReqType"] = Requests::Cancel;
+    request["UserId"] = "1";
+    request["Message"] = "4294967299";
+    std::string response17 = sendRequest(request);
+    EXPECT_EQ(response17, "Unknown order\n");
+}
+
+
+TEST_F(TradingServerTest, IcebergRefreshLosesPriority) {
+    nlohmann::json request;
+    request["ReqType"] = Requests::Free;
+    request["Message"] = "bibip";
+    connectToServer();
+    sendRequest(request);
+
+    // Регистрация пользователей
+    request["ReqType"] = Requests::Registration;
+    request["Message"] = "User1";
+    std::string response1 = sendRequest(request);
+    EXPECT_EQ(response1, "0");
+
+    request["Message"] = "User2";
+    std::string response2 = sendRequest(request);
+    EXPECT_EQ(response2, "1");
+
+    request["Message"] = "User3";
+    std::string response3 = sendRequest(request);
+    EXPECT_EQ(response3, "2");
+    fundUsers(3);
+
+    // Айсберг на 5 с видимой частью 2
+    request["ReqType"] = Requests::Trading;
+    request["UserId"] = "0";
+    request["Peak"] = "2";
+    request["Message"] = "5:100:sell";
+    std::string response4 = sendRequest(request);
+    EXPECT_EQ(response4, "Your application is being processed, order id 0\n");
+
+    request["Type"] = "market";
+    request["Message"] = "5::sell";
+    std::string response5 = sendRequest(request);
+    EXPECT_EQ(response5, "Incorrect input\n");
+
+    request.erase("Peak");
+    request["Type"] = "limit";
+    request["UserId"] = "1";
+    request["Message"] = "3:100:sell";
+    std::string response6 = sendRequest(request);
+    EXPECT_EQ(response6, "Your application is being processed, order id 1\n");
+
+    // Видимая часть исполнена и пополнена, айсберг уходит в конец очереди
+    request["UserId"] = "2";
+    request["Message"] = "3:100:buy";
+    std::string response7 = sendRequest(request);
+    EXPECT_EQ(response7, "Your application is being processed\n");
+
+    request["Message"] = "2:100:buy";
+    std::string response8 = sendRequest(request);
+    EXPECT_EQ(response8, "Your application is being processed\n");
+
+    // Уменьшение сначала забирает скрытый резерв
+    request["ReqType"] = Requests::Amend;
+    request["UserId"] = "0";
+    request["Message"] = "0:2:100";
+    std::string response9 = sendRequest(request);
+    EXPECT_EQ(response9, "Order amended\n");
+
+    request["ReqType"] = Requests::Trading;
+    request["UserId"] = "2";
+    request["Type"] = "fok";
+    request["Message"] = "3:100:buy";
+    std::string response10 = sendRequest(request);
+    EXPECT_EQ(response10, "Order killed\n");
+
+    request["Type"] = "limit";
+    request["Message"] = "2:100:buy";
+    std::string response11 = sendRequest(request);
+    EXPECT_EQ(response11, "Your application is being processed\n");
+
+    request["ReqType"] = Requests::Cancel;
+    request["UserId"] = "0";
+    request["Message"] = "0";
+    std::string response12 = sendRequest(request);
+    EXPECT_EQ(response12, "Unknown order\n");
+
+    // Проверка статуса
+    request["ReqType"] = Requests::Status;
+    std::string status1 = sendRequest(request);
+    EXPECT_EQ(status1, "USD 996.000000, Money 100400.000000\n");
+
+    request["UserId"] = "1";
+    std::string status2 = sendRequest(request);
+    EXPECT_EQ(status2, "USD 997.000000, Money 100300.000000\n");
+
+    request["UserId"] = "2";
+    std::string status3 = sendRequest(request);
+    EXPECT_EQ(status3, "USD 1007.000000, Money 99300.000000\n");
+}
+
+
+TEST_F(TradingServerTest, OrdersExpireByTimeAndSession) {
+    nlohmann::json request;
+    request["ReqType"] = Requests::Free;
+    request["Message"] = "bibip";
+    connectToServer();
+    sendRequest(request);
+
+    // Регистрация пользователей
+    request["ReqType"] = Requests::Registration;
+    request["Message"] = "User1";
+    std::string response1 = sendRequest(request);
+    EXPECT_EQ(response1, "0");
+
+    request["Message"] = "User2";
+    std::string response2 = sendRequest(request);
+    EXPECT_EQ(response2, "1");
+
+    request["Message"] = "User3";
+    std::string response3 = sendRequest(request);
+    EXPECT_EQ(response3, "2");
+    fundUsers(3);
+
+    // Заявка со сроком через 100 мс (срок можно передать числом) и заявка на день
+    auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    request["ReqType"] = Requests::Trading;
+    request["UserId"] = "0";
+    request["Expire"] = now + 100;
+    request["Message"] = "5:100:sell";
+    std::string response4 = sendRequest(request);
+    EXPECT_EQ(response4, "Your application is being processed, order id 0\n");
+
+    request["Expire"] = "day";
+    request["Message"] = "5:101:sell";
+    std::string response5 = sendRequest(request);
+    EXPECT_EQ(response5, "Your application is being processed, order id 1\n");
+
+    // Срок в прошлом и срок у немедленной заявки
+    request["Expire"] = "1";
+    std::string response6 = sendRequest(request);
+    EXPECT_EQ(response6, "Incorrect input\n");
+
+    request["Expire"] = "day";
+    request["Type"] = "ioc";
+    std::string response7 = sendRequest(request);
+    EXPECT_EQ(response7, "Incorrect input\n");
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    // Истекшая заявка по 100 уже снята
+    request.erase("Expire");
+    request["Type"] = "limit";
+    request["UserId"] = "1";
+    request["Message"] = "3:101:buy";
+    std::string response8 = sendRequest(request);
+    EXPECT_EQ(response8, "Your application is being processed\n");
+
+    request["ReqType"] = Requests::EndOfSession;
+    std::string response9 = sendRequest(request);
+    EXPECT_EQ(response9, "Session closed\n");
+
+    request["ReqType"] = Requests::Trading;
+    request["UserId"] = "2";
+    request["Message"] = "1:101:buy";
+    std::string response10 = sendRequest(request);
+    EXPECT_EQ(response10, "Your application is being processed, order id 4294967297\n");
+
+    // Поля неверного типа отклоняются, сервер продолжает работу
+    request["Expire"] = true;
+    std::string response11 = sendRequest(request);
+    EXPECT_EQ(response11, "Incorrect input\n");
+
+    request.erase("Expire");
+    request["PostOnly"] = "yes";
+    std::string response12 = sendRequest(request);
+    EXPECT_EQ(response12, "Incorrect input\n");
+    request.erase("PostOnly");
+
+    request["ReqType"] = Requests::Status;
+    request["Symbol"] = 5;
+    std::string response13 = sendRequest(request);
+    EXPECT_EQ(response13, "Incorrect input\n");
+    request.erase("Symbol");
+
+    // Проверка статуса
+    request["UserId"] = "0";
+    std::string status1 = sendRequest(request);
+    EXPECT_EQ(status1, "USD 997.000000, Money 100303.000000\n");
+
+    request["UserId"] = "1";
+    std::string status2 = sendRequest(request);
+    EXPECT_EQ(status2, "USD 1003.000000, Money 99697.000000\n");
+}
+
+
+TEST_F(TradingServerTest, CallAuctionUncross) {
+    nlohmann::json request;
+    request["ReqType"] = Requests::Free;
+    request["Message"] = "bibip";
+    connectToServer();
+    sendRequest(request);
+
+    // Регистрация пользователей
+    request["ReqType"] = Requests::Registration;
+    request["Message"] = "User1";
+    std::string response1 = sendRequest(request);
+    EXPECT_EQ(response1, "0");
+
+    request["Message"] = "User2";
+    std::string response2 = sendRequest(request);
+    EXPECT_EQ(response2, "1");
+
+    request["Message"] = "User3";
+    std::string response3 = sendRequest(request);
+    EXPECT_EQ(response3, "2");
+    fundUsers(3);
+
+    request["ReqType"] = Requests::Auction;
+    request["Message"] = "start";
+    std::string response4 = sendRequest(request);
+    EXPECT_EQ(response4, "Auction started\n");
+
+    // Пересекающиеся заявки копятся без сделок
+    request["ReqType"] = Requests::Trading;
+    request["UserId"] = "0";
+    request["Message"] = "5:102:buy";
+    std::string response5 = sendRequest(request);
+    EXPECT_EQ(response5, "Your application is being processed, order id 0\n");
+
+    request["UserId"] = "1";
+    request["Message"] = "3:100:sell";
+    std::string response6 = sendRequest(request);
+    EXPECT_EQ(response6, "Your application is being processed, order id 1\n");
+
+    request["UserId"] = "2";
+    request["Message"] = "4:101:sell";
+    std::string response7 = sendRequest(request);
+    EXPECT_EQ(response7, "Your application is being processed, order id 2\n");
+
+    request["Type"] = "market";
+    request["Message"] = "1::sell";
+    std::string response8 = sendRequest(request);
+    EXPECT_EQ(response8, "Auction in progress\n");
+
+    request["ReqType"] = Requests::Status;
+    request["UserId"] = "0";
+    std::string status1 = sendRequest(request);
+    EXPECT_EQ(status1, "USD 1000.000000, Money 100000.000000\n");
+
+    // Наибольший объем 5 исполняется и по 101, и по 102, берется меньшая цена
+    request["ReqType"] = Requests::Auction;
+    request["Message"] = "uncross";
+    std::string response9 = sendRequest(request);
+    EXPECT_EQ(response9, "Auction closed at 101.000000, volume 5.000000\n");
+
+    std::string response10 = sendRequest(request);
+    EXPECT_EQ(response10, "Incorrect input\n");
+
+    // Проверка статуса
+    request["ReqType"] = Requests::Status;
+    std::string status2 = sendRequest(request);
+    EXPECT_EQ(status2, "USD 1005.000000, Money 99495.000000\n");
+
+    request["UserId"] = "1";
+    std::string status3 = sendRequest(request);
+    EXPECT_EQ(status3, "USD 997.000000, Money 100303.000000\n");
+
+    request["UserId"] = "2";
+    std::string status4 = sendRequest(request);
+    EXPECT_EQ(status4, "USD 998.000000, Money 100202.000000\n");
+}
+
+
+TEST_F(TradingServerTest, ProRataAllocation) {
+    nlohmann::json request;
+    request["ReqType"] = Requests::Free;
+    request["Message"] = "bibip";
+    connectToServer();
+    sendRequest(request);
+
+    // Регистрация пользователей
+    request["ReqType"] = Requests::Registration;
+    request["Message"] = "User1";
+    std::string response1 = sendRequest(request);
+    EXPECT_EQ(response1, "0");
+
+    request["Message"] = "User2";
+    std::string response2 = sendRequest(request);
+    EXPECT_EQ(response2, "1");
+
+    request["Message"] = "User3";
+    std::string response3 = sendRequest(request);
+    EXPECT_EQ(response3, "2");
+
+    request["Message"] = "User4";
+    std::string response4 = sendRequest(request);
+    EXPECT_EQ(response4, "3");
+    fundUsers(4);
+
+    // Минимальная доля - 1 USD
+    request["ReqType"] = Requests::Policy;
+    request["Message"] = "pro-rata:1";
+    std::string response5 = sendRequest(request);
+    EXPECT_EQ(response5, "Policy set\n");
+
+    request["Message"] = "random";
+    std::string response6 = sendRequest(request);
+    EXPECT_EQ(response6, "Incorrect input\n");
+
+    request["ReqType"] = Requests::Trading;
+    request["UserId"] = "0";
+    request["Message"] = "6:100:sell";
+    std::string response7 = sendRequest(request);
+    EXPECT_EQ(response7, "Your application is being processed, order id 0\n");
+
+    request["UserId"] = "1";
+    request["Message"] = "3:100:sell";
+    std::string response8 = sendRequest(request);
+    EXPECT_EQ(response8, "Your application is being processed, order id 1\n");
+
+    request["UserId"] = "2";
+    request["Message"] = "1:100:sell";
+    std::string response9 = sendRequest(request);
+    EXPECT_EQ(response9, "Your application is being processed, order id 2\n");
+
+    // Доли 3, 1.5 и 0.5; последняя меньше минимальной и достается первой в очереди
+    request["UserId"] = "3";
+    request["Message"] = "5:100:buy";
+    std::string response10 = sendRequest(request);
+    EXPECT_EQ(response10, "Your application is being processed\n");
+
+    // Обратно к распределению по времени
+    request["ReqType"] = Requests::Policy;
+    request["Message"] = "price-time";
+    std::string response11 = sendRequest(request);
+    EXPECT_EQ(response11, "Policy set\n");
+
+    request["ReqType"] = Requests::Trading;
+    request["Message"] = "1:100:buy";
+    std::string response12 = sendRequest(request);
+    EXPECT_EQ(response12, "Your application is being processed\n");
+
+    // Проверка статуса
+    request["ReqType"] = Requests::Status;
+    request["UserId"] = "0";
+    std::string status1 = sendRequest(request);
+    EXPECT_EQ(status1, "USD 995.500000, Money 100450.000000\n");
+
+    request["UserId"] = "1";
+    std::string status2 = sendRequest(request);
+    EXPECT_EQ(status2, "USD 998.500000, Money 100150.000000\n");
+
+    request["UserId"] = "2";
+    std::string status3 = sendRequest(request);
+    EXPECT_EQ(status3, "USD 1000.000000, Money 100000.000000\n");
+
+    request["UserId"] = "3";
+    std::string status4 = sendRequest(request);
+    EXPECT_EQ(status4, "USD 1006.000000, Money 99400.000000\n");
+}
+
+
+TEST_F(TradingServerTest, PostOnlyAndMinimumQuantity) {
+    nlohmann::json request;
+    request["ReqType"] = Requests::Free;
+    request["Message"] = "bibip";
+    connectToServer();
+    sendRequest(request);
+
+    // Регистрация пользователей
+    request["ReqType"] = Requests::Registration;
+    request["Message"] = "User1";
+    std::string response1 = sendRequest(request);
+    EXPECT_EQ(response1, "0");
+
+    request["Message"] = "User2";
+    std::string response2 = sendRequest(request);
+    EXPECT_EQ(response2, "1");
+    fundUsers(2);
+
+    request["ReqType"] = Requests::Trading;
+    request["UserId"] = "0";
+    request["Message"] = "5:100:sell";
+    std::string response3 = sendRequest(request);
+    EXPECT_EQ(response3, "Your application is being processed, order id 0\n");
+
+    // Post-only отклоняется, если пересекает лучшую встречную цену
+    request["UserId"] = "1";
+    request["PostOnly"] = true;
+    request["Message"] = "1:100:buy";
+    std::string response4 = sendRequest(request);
+    EXPECT_EQ(response4, "Post-only order would cross\n");
+
+    request["Message"] = "1:99:buy";
+    std::string response5 = sendRequest(request);
+    EXPECT_EQ(response5, "Your application is being processed, order id 1\n");
+
+    request["ReqType"] = Requests::Amend;
+    request["Message"] = "1:1:100";
+    std::string response6 = sendRequest(request);
+    EXPECT_EQ(response6, "Post-only order would cross\n");
+
+    request["ReqType"] = Requests::Trading;
+    request["Type"] = "market";
+    request["Message"] = "1::buy";
+    std::string response7 = sendRequest(request);
+    EXPECT_EQ(response7, "Incorrect input\n");
+
+    // Минимальный объем исполнения
+    request.erase("PostOnly");
+    request["Type"] = "limit";
+    request["MinQty"] = "6";
+    request["Message"] = "10:100:buy";
+    std::string response8 = sendRequest(request);
+    EXPECT_EQ(response8, "Order killed\n");
+
+    request["MinQty"] = "11";
+    std::string response9 = sendRequest(request);
+    EXPECT_EQ(response9, "Incorrect input\n");
+
+    request["MinQty"] = "5";
+    std::string response10 = sendRequest(request);
+    EXPECT_EQ(response10, "Your application is being processed, order id 4294967296\n");
+
+    // Проверка статуса
+    request["ReqType"] = Requests::Status;
+    std::string status1 = sendRequest(request);
+    EXPECT_EQ(status1, "USD 1005.000000, Money 99500.000000\n");
+
+    request["UserId"] = "0";
+    std::string status2 = sendRequest(request);
+    EXPECT_EQ(status2, "USD 995.000000, Money 100500.000000\n");
+}
+
+
+TEST_F(TradingServerTest, MinimumQuantityStopsAtOwnOrder) {
+    nlohmann::json request;
+    request["ReqType"] = Requests::Free;
+    request["Message"] = "bibip";
+    connectToServer();
+    sendRequest(request);
+
+    // Регистрация пользователей
+    request["ReqType"] = Requests::Registration;
+    request["Message"] = "User1";
+    std::string response1 = sendRequest(request);
+    EXPECT_EQ(response1, "0");
+
+    request["Message"] = "User2";
+    std::string response2 = sendRequest(request);
+    EXPECT_EQ(response2, "1");
+    fundUsers(2);
+
+    // Своя заявка между чужими уровнями
+    request["ReqType"] = Requests::Trading;
+    request["UserId"] = "1";
+    request["Message"] = "5:99:sell";
+    std::string response3 = sendRequest(request);
+    EXPECT_EQ(response3, "Your application is being processed, order id 0\n");
+
+    request["UserId"] = "0";
+    request["Message"] = "10:100:sell";
+    std::string response4 = sendRequest(request);
+    EXPECT_EQ(response4, "Your application is being processed, order id 1\n");
+
+    request["UserId"] = "1";
+    request["Message"] = "10:101:sell";
+    std::string response5 = sendRequest(request);
+    EXPECT_EQ(response5, "Your application is being processed, order id 2\n");
+
+    // При "cancel-newest" до своей заявки доступно 5, меньше минимума
+    request["UserId"] = "0";
+    request["Stp"] = "cancel-newest";
+    request["MinQty"] = "8";
+    request["Message"] = "10:101:buy";
+    std::string response6 = sendRequest(request);
+    EXPECT_EQ(response6, "Order killed\n");
+
+    request["MinQty"] = "5";
+    std::string response7 = sendRequest(request);
+    EXPECT_EQ(response7, "Order cancelled, remaining 5.000000\n");
+
+    request["ReqType"] = Requests::Status;
+    std::string status1 = sendRequest(request);
+    EXPECT_EQ(status1, "USD 1005.000000, Money 99505.000000\n");
+}
+
+TEST_F(TradingServerTest, PriceBandsAndCircuitBreaker) {
+    nlohmann::json request;
+    request["ReqType"] = Requests::Free;
+    request["Message"] = "bibip";
+    connectToServer();
+    sendRequest(request);
+
+    // Регистрация пользователей
+    request["ReqType"] = Requests::Registration;
+    request["Message"] = "User1";
+    std::string response1 = sendRequest(request);
+    EXPECT_EQ(response1, "0");
+
+    request["Message"] = "User2";
+    std::string response2 = sendRequest(request);
+    EXPECT_EQ(response2, "1");
+    fundUsers(2);
+
+    // Полоса 5%, остановка при движении на 8% за минуту
+    request["ReqType"] = Requests::PriceBands;
+    request["Message"] = "5:8:60000";
+    std::string response3 = sendRequest(request);
+    EXPECT_EQ(response3, "Price bands set\n");
+
+    request["ReqType"] = Requests::Trading;
+    request["UserId"] = "0";
+    request["Message"] = "1:100:sell";
+    std::string response4 = sendRequest(request);
+    EXPECT_EQ(response4, "Your application is being processed, order id 0\n");
+
+    request["UserId"] = "1";
+    request["Message"] = "1:100:buy";
+    std::string response5 = sendRequest(request);
+    EXPECT_EQ(response5, "Your application is being processed\n");
+
+    // Полоса после сделки по 100 - от 95 до 105
+    request["UserId"] = "0";
+    request["Message"] = "1:110:sell";
+    std::string response6 = sendRequest(request);
+    EXPECT_EQ(response6, "Price out of band\n");
+
+    request["Message"] = "1:104:sell";
+    std::string response7 = sendRequest(request);
+    EXPECT_EQ(response7, "Your application is being processed, order id 4294967296\n");
+
+    request["UserId"] = "1";
+    request["Message"] = "1:104:buy";
+    std::string response8 = sendRequest(request);
+    EXPECT_EQ(response8, "Your application is being processed\n");
+
+    // Сделка по 109 - рост на 9% от минимума окна, торги останавливаются
+    request["UserId"] = "0";
+    request["Message"] = "2:109:sell";
+    std::string response9 = sendRequest(request);
+    EXPECT_EQ(response9, "Your application is being processed, order id 8589934592\n");
+
+    request["UserId"] = "1";
+    request["Message"] = "2:109:buy";
+    std::string response10 = sendRequest(request);
+    EXPECT_EQ(response10, "Your application is being processed\n");
+
+    request["Type"] = "market";
+    request["Message"] = "1::buy";
+    std::string response11 = sendRequest(request);
+    EXPECT_EQ(response11, "Auction in progress\n");
+
+    request["ReqType"] = Requests::Auction;
+    request["Message"] = "uncross";
+    std::string response12 = sendRequest(request);
+    EXPECT_EQ(response12, "Auction closed, volume 0.000000\n");
+
+    // Проверка статуса
+    request["ReqType"] = Requests::Status;
+    std::string status1 = sendRequest(request);
+    EXPECT_EQ(status1, "USD 1004.000000, Money 99578.000000\n");
+
+    request["UserId"] = "0";
+    std::string status2 = sendRequest(request);
+    EXPECT_EQ(status2, "USD 996.000000, Money 100422.000000\n");
+}
+
+
+TEST_F(TradingServerTest, HaltKeepsPendingStops) {
+    nlohmann::json request;
+    request["ReqType"] = Requests::Free;
+    request["Message"] = "bibip";
+    connectToServer();
+    sendRequest(request);
+
+    // Регистрация пользователей
+    request["ReqType"] = Requests::Registration;
+    request["Message"] = "User1";
+    std::string response1 = sendRequest(request);
+    EXPECT_EQ(response1, "0");
+
+    request["Message"] = "User2";
+    std::string response2 = sendRequest(request);
+    EXPECT_EQ(response2, "1");
+
+    request["Message"] = "User3";
+    std::string response3 = sendRequest(request);
+    EXPECT_EQ(response3, "2");
+    fundUsers(3);
+
+    // Остановка при движении на 5% за минуту, последняя сделка по 100
+    request["ReqType"] = Requests::PriceBands;
+    request["Message"] = "50:5:60000";
+    std::string response4 = sendRequest(request);
+    EXPECT_EQ(response4, "Price bands set\n");
+
+    request["ReqType"] = Requests::Trading;
+    request["UserId"] = "1";
+    request["Message"] = "1:100:sell";
+    std::string response5 = sendRequest(request);
+    EXPECT_EQ(response5, "Your application is being processed, order id 0\n");
+
+    request["UserId"] = "0";
+    request["Message"] = "1:100:buy";
+    std::string response6 = sendRequest(request);
+    EXPECT_EQ(response6, "Your application is being processed\n");
+
+    // Два стопа на покупку по 101
+    request["Type"] = "stop";
+    request["StopPrice"] = "101";
+    request["Message"] = "1::buy";
+    std::string response7 = sendRequest(request);
+    EXPECT_EQ(response7, "Your application is being processed, order id 4294967296\n");
+
+    std::string response8 = sendRequest(request);
+    EXPECT_EQ(response8, "Your application is being processed, order id 1\n");
+
+    request.erase("StopPrice");
+    request["Type"] = "limit";
+    request["UserId"] = "1";
+    request["Message"] = "1:101:sell";
+    std::string response9 = sendRequest(request);
+    EXPECT_EQ(response9, "Your application is being processed, order id 2\n");
+
+    request["Message"] = "5:110:sell";
+    std::string response10 = sendRequest(request);
+    EXPECT_EQ(response10, "Your application is being processed, order id 3\n");
+
+    // Первый стоп покупает по 110 и останавливает торги, второй ждет аукциона
+    request["UserId"] = "2";
+    request["Message"] = "1:101:buy";
+    std::string response11 = sendRequest(request);
+    EXPECT_EQ(response11, "Your application is being processed\n");
+
+    request["ReqType"] = Requests::Status;
+    request["UserId"] = "0";
+    std::string status1 = sendRequest(request);
+    EXPECT_EQ(status1, "USD 1002.000000, Money 99790.000000\n");
+
+    request["ReqType"] = Requests::Cancel;
+    request["Message"] = "1";
+    std::string response12 = sendRequest(request);
+    EXPECT_EQ(response12, "Order cancelled\n");
+}
+
+TEST_F(TradingServerTest, HaltInterruptsProRata) {
+    nlohmann::json request;
+    request["ReqType"] = Requests::Free;
+    request["Message"] = "bibip";
+    connectToServer();
+    sendRequest(request);
+
+    // Регистрация пользователей
+    request["ReqType"] = Requests::Registration;
+    request["Message"] = "User1";
+    std::string response1 = sendRequest(request);
+    EXPECT_EQ(response1, "0");
+
+    request["Message"] = "User2";
+    std::string response2 = sendRequest(request);
+    EXPECT_EQ(response2, "1");
+
+    request["Message"] = "User3";
+    std::string response3 = sendRequest(request);
+    EXPECT_EQ(response3, "2");
+    fundUsers(3);
+
+    // Остановка при движении на 5% за минуту, последняя сделка по 100
+    request["ReqType"] = Requests::PriceBands;
+    request["Message"] = "50:5:60000";
+    std::string response4 = sendRequest(request);
+    EXPECT_EQ(response4, "Price bands set\n");
+
+    request["ReqType"] = Requests::Trading;
+    request["UserId"] = "1";
+    request["Message"] = "1:100:sell";
+    std::string response5 = sendRequest(request);
+    EXPECT_EQ(response5, "Your application is being processed, order id 0\n");
+
+    request["UserId"] = "0";
+    request["Message"] = "1:100:buy";
+    std::string response6 = sendRequest(request);
+    EXPECT_EQ(response6, "Your application is being processed\n");
+
+    request["ReqType"] = Requests::Policy;
+    request["Message"] = "pro-rata";
+    std::string response7 = sendRequest(request);
+    EXPECT_EQ(response7, "Policy set\n");
+
+    request["ReqType"] = Requests::Trading;
+    request["UserId"] = "1";
+    request["Message"] = "4:110:sell";
+    std::string response8 = sendRequest(request);
+    EXPECT_EQ(response8, "Your application is being processed, order id 4294967296\n");
+
+    request["UserId"] = "2";
+    std::string response9 = sendRequest(request);
+    EXPECT_EQ(response9, "Your application is being processed, order id 1\n");
+
+    // Первая доля по 110 останавливает торги, остаток встает в стакан аукциона
+    request["UserId"] = "0";
+    request["Message"] = "4:110:buy";
+    std::string response10 = sendRequest(request);
+    EXPECT_EQ(response10, "Your application is being processed, order id 2\n");
+
+    request["ReqType"] = Requests::Status;
+    std::string status1 = sendRequest(request);
+    EXPECT_EQ(status1, "USD 1003.000000, Money 99680.000000\n");
+
+    request["UserId"] = "2";
+    std::string status2 = sendRequest(request);
+    EXPECT_EQ(status2, "USD 1000.000000, Money 100000.000000\n");
+}
+
+TEST_F(TradingServerTest, ExecutionReports) {
+    nlohmann::json request;
+    request["ReqType"] = Requests::Free;
+    request["Message"] = "bibip";
+    connectToServer();
+    sendRequest(request);
+
+    // Регистрация пользователей
+    request["ReqType"] = Requests::Registration;
+    request["Message"] = "User1";
+    std::string response1 = sendRequest(request);
+    EXPECT_EQ(response1, "0");
+
+    request["Message"] = "User2";
+    std::string response2 = sendRequest(request);
+    EXPECT_EQ(response2, "1");
+    fundUsers(2);
+
+    request["ReqType"] = Requests::Executions;
+    request["UserId"] = "0";
+    request["Message"] = "1";
+    std::string response3 = sendRequest(request);
+    EXPECT_EQ(response3, "No executions\n");
+
+    request["ReqType"] = Requests::Trading;
+    request["Message"] = "1:100:sell";
+    std::string response4 = sendRequest(request);
+    EXPECT_EQ(response4, "Your application is being processed, order id 0\n");
+
+    request["Message"] = "2:101:sell";
+    std::string response5 = sendRequest(request);
+    EXPECT_EQ(response5, "Your application is being processed, order id 1\n");
+
+    // Одна заявка проходит два уровня - два отчета
+    request["UserId"] = "1";
+    request["Message"] = "2.5:101:buy";
+    std::string response6 = sendRequest(request);
+    EXPECT_EQ(response6, "Your application is being processed\n");
+
+    request["ReqType"] = Requests::Executions;
+    request["Message"] = "1";
+    std::string response7 = sendRequest(request);
+    EXPECT_EQ(response7,
+        "Execution 1: USD 1.000000 at 100.000000, taker 1, maker 0, remaining 1.500000\n"
+        "Execution 2: USD 1.500000 at 101.000000, taker 1, maker 0, remaining 0.000000\n");
+
+    request["UserId"] = "0";
+    request["Message"] = "2";
+    std::string response8 = sendRequest(request);
+    EXPECT_EQ(response8, "Execution 2: USD 1.500000 at 101.000000, taker 1, maker 0, remaining 0.000000\n");
+
+    request["Message"] = "3";
+    std::string response9 = sendRequest(request);
+    EXPECT_EQ(response9, "No executions\n");
+}
+
+
+TEST_F(TradingServerTest, UnknownUsersAreRejected) {
+    nlohmann::json request;
+    request["ReqType"] = Requests::Free;
+    request["Message"] = "bibip";
+    connectToServer();
+    sendRequest(request);
+
+    request["ReqType"] = Requests::Registration;
+    request["Message"] = "User1";
+    std::string response1 = sendRequest(request);
+    EXPECT_EQ(response1, "0");
+
+    // Запросы от незарегистрированного ID не заводят счет
+    request["ReqType"] = Requests::Status;
+    request["UserId"] = "1";
+    std::string status1 = sendRequest(request);
+    EXPECT_EQ(status1, "Error! Unknown User\n");
+
+    request["ReqType"] = Requests::Trading;
+    request["Message"] = "1:100:buy";
+    std::string response2 = sendRequest(request);
+    EXPECT_EQ(response2, "Error! Unknown User\n");
+
+    request["ReqType"] = Requests::Cancel;
+    request["Message"] = "0";
+    std::string response6 = sendRequest(request);
+    EXPECT_EQ(response6, "Error! Unknown User\n");
+
+    request["ReqType"] = Requests::Amend;
+    request["Message"] = "0:1:100";
+    std::string response7 = sendRequest(request);
+    EXPECT_EQ(response7, "Error! Unknown User\n");
+
+    request["ReqType"] = Requests::Executions;
+    request["Message"] = "0";
+    std::string response8 = sendRequest(request);
+    EXPECT_EQ(response8, "Error! Unknown User\n");
+
+    request["ReqType"] = Requests::Registration;
+    request["Message"] = "User2";
+    std::string response3 = sendRequest(request);
+    EXPECT_EQ(response3, "1");
+
+    // Повторная регистрация возвращает прежний ID
+    request["Message"] = "User1";
+    std::string response4 = sendRequest(request);
+    EXPECT_EQ(response4, "0");
+
+    request["ReqType"] = Requests::Hello;
+    std::string response5 = sendRequest(request);
+    EXPECT_EQ(response5, "Hello, User2!\n");
+}
+
+
+TEST_F(TradingServerTest, OrderPoolCounters) {
+    nlohmann::json request;
+    request["ReqType"] = Requests::Free;
+    request["Message"] = "bibip";
+    connectToServer();
+    sendRequest(request);
+
+    request["ReqType"] = Requests::Registration;
+    request["Message"] = "User1";
+    std::string response1 = sendRequest(request);
+    EXPECT_EQ(response1, "0");
+
+    request["ReqType"] = Requests::OrderPool;
+    std::string response2 = sendRequest(request);
+    EXPECT_EQ(response2, "Orders resting 0, high water mark 0\n");
+
+    request["ReqType"] = Requests::Deposit;
+    request["UserId"] = "0";
+    request["Message"] = "10:0";
+    std::string response3 = sendRequest(request);
+    EXPECT_EQ(response3, "Deposit accepted\n");
+
+    request["ReqType"] = Requests::Trading;
+    request["Message"] = "1:100:sell";
+    std::string response4 = sendRequest(request);
+    EXPECT_EQ(response4, "Your application is being processed, order id 0\n");
+
+    request["Message"] = "1:101:sell";
+    std::string response5 = sendRequest(request);
+    EXPECT_EQ(response5, "Your application is being processed, order id 1\n");
+
+    // Снятая заявка освобождает слот, максимум остается
+    request["ReqType"] = Requests::Cancel;
+    request["Message"] = "0";
+    std::string response6 = sendRequest(request);
+    EXPECT_EQ(response6, "Order cancelled\n");
+
+    request["ReqType"] = Requests::OrderPool;
+    std::string response7 = sendRequest(request);
+    EXPECT_EQ(response7, "Orders resting 1, high water mark 2\n");
+}
+
+// Читатель под SeqLock видит только согласованные пары значений, пока
+// писатель в другом потоке их меняет.
+TEST_F(TradingServerTest, ProRataAppliesToStpTakers) {
+    nlohmann::json request;
+    request["ReqType"] = Requests::Free;
+    request["Message"] = "bibip";
+    connectToServer();
+    sendRequest(request);
+
+    // Регистрация пользователей
+    request["ReqType"] = Requests::Registration;
+    request["Message"] = "User1";
+    std::string response1 = sendRequest(request);
+    EXPECT_EQ(response1, "0");
+
+    request["Message"] = "User2";
+    std::string response2 = sendRequest(request);
+    EXPECT_EQ(response2, "1");
+
+    request["Message"] = "User3";
+    std::string response3 = sendRequest(request);
+    EXPECT_EQ(response3, "2");
+    fundUsers(3);
+
+    request["ReqType"] = Requests::Policy;
+    request["Message"] = "pro-rata";
+    std::string response4 = sendRequest(request);
+    EXPECT_EQ(response4, "Policy set\n");
+
+    request["ReqType"] = Requests::Trading;
+    request["UserId"] = "0";
+    request["Message"] = "10:100:sell";
+    std::string response5 = sendRequest(request);
+    EXPECT_EQ(response5, "Your application is being processed, order id 0\n");
+
+    request["UserId"] = "1";
+    request["Message"] = "30:100:sell";
+    std::string response6 = sendRequest(request);
+    EXPECT_EQ(response6, "Your application is being processed, order id 1\n");
+
+    // Своих заявок на уровне нет, STP не отменяет распределения: доли 5 и 15
+    request["UserId"] = "2";
+    request["Stp"] = "cancel-oldest";
+    request["Message"] = "20:100:buy";
+    std::string response7 = sendRequest(request);
+    EXPECT_EQ(response7, "Your application is being processed\n");
+
+    // Проверка статуса
+    request["ReqType"] = Requests::Status;
+    request["UserId"] = "0";
+    std::string status1 = sendRequest(request);
+    EXPECT_EQ(status1, "USD 995.000000, Money 100500.000000\n");
+
+    request["UserId"] = "1";
+    std::string status2 = sendRequest(request);
+    EXPECT_EQ(status2, "USD 985.000000, Money 101500.000000\n");
+}
+
+TEST_F(TradingServerTest, LadderFollowsMarketAfterOffBandOrder) {
+    nlohmann::json request;
+    request["ReqType"] = Requests::Free;
+    request["Message"] = "bibip";
+    connectToServer();
+    sendRequest(request);
+
+    // Регистрация пользователей
+    request["ReqType"] = Requests::Registration;
+    request["Message"] = "User1";
+    std::string response1 = sendRequest(request);
+    EXPECT_EQ(response1, "0");
+
+    request["Message"] = "User2";
+    std::string response2 = sendRequest(request);
+    EXPECT_EQ(response2, "1");
+
+    request["Message"] = "User3";
+    std::string response3 = sendRequest(request);
+    EXPECT_EQ(response3, "2");
+    fundUsers(3);
+
+    // Первая заявка далеко от рынка задает полосу лестницы
+    request["ReqType"] = Requests::Trading;
+    request["UserId"] = "0";
+    request["Message"] = "1:1:buy";
+    std::string response4 = sendRequest(request);
+    EXPECT_EQ(response4, "Your application is being processed, order id 0\n");
+
+    // Заявки по рынку переносят полосу, уровень 1.00 уходит из лестницы
+    request["UserId"] = "1";
+    request["Message"] = "2:100:buy";
+    std::string response5 = sendRequest(request);
+    EXPECT_EQ(response5, "Your application is being processed, order id 1\n");
+
+    request["Message"] = "2:100.5:buy";
+    std::string response6 = sendRequest(request);
+    EXPECT_EQ(response6, "Your application is being processed, order id 2\n");
+
+    // Перенесенный уровень остается доступен заявке
+    request["ReqType"] = Requests::Amend;
+    request["UserId"] = "0";
+    request["Message"] = "0:0.5:1";
+    std::string response7 = sendRequest(request);
+    EXPECT_EQ(response7, "Order amended\n");
+
+    // Продажа проходит уровни от лучшей цены к худшей
+    request["ReqType"] = Requests::Trading;
+    request["UserId"] = "2";
+    request["Message"] = "4.5:1:sell";
+    std::string response8 = sendRequest(request);
+    EXPECT_EQ(response8, "Your application is being processed\n");
+
+    // Проверка статуса
+    request["ReqType"] = Requests::Status;
+    request["UserId"] = "0";
+    std::string status1 = sendRequest(request);
+    EXPECT_EQ(status1, "USD 1000.500000, Money 99999.500000\n");
+
+    request["UserId"] = "1";
+    std::string status2 = sendRequest(request);
+    EXPECT_EQ(status2, "USD 1004.000000, Money 99599.000000\n");
+
+    request["UserId"] = "2";
+    std::string status3 = sendRequest(request);
+    EXPECT_EQ(status3, "USD 995.500000, Money 100401.500000\n");
+}
+
+TEST(SeqLockTest, ConcurrentReaderSeesConsistentPairs) {
+    SeqLock version;
+    SeqLockField<int64_t> usd = 0;
+    SeqLockField<int64_t> money = 0;
+    std::atomic<bool> done{false};
+    std::thread writer([&] {
+        for (int i = 0; i < 200000; ++i) {
+            SeqLock::Writer write(version);
+            usd += 1;
+            money -= 100;
+        }
+        done = true;
+    });
+
+    long torn = 0;
+    while (!done.load()) {
+        int64_t readUsd = 0;
+        int64_t readMoney = 0;
+        version.Read([&] {
+            readUsd = usd;
+            readMoney = money;
+        });
+        if (readMoney != -100 * readUsd)
+            ++torn;
+    }
+    writer.join();
+    EXPECT_EQ(torn, 0);
+    EXPECT_EQ(usd.Load(), 200000);
+    EXPECT_EQ(money.Load(), -20000000);
+}
 
 int main(int argc, char** argv) {
     testing::InitGoogleTest(&argc, argv);